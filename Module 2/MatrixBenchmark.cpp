@@ -0,0 +1,240 @@
+/* MatrixBenchmark.cpp
+ *
+ * Benchmark driver for the shared memory matrix multiplication variants: sequential, pthread pool,
+ * OpenMP and Strassen. Every size is run with a fixed seed, a sequential baseline is timed once per
+ * size and each variant is timed for every thread count, reporting median / p10 / p90, GOP/s and
+ * parallel efficiency as CSV or JSON lines (see benchmark.h). The output of every variant is checked
+ * with Freivalds' O(N^2) test from verify.h outside the timed region. The MPI programs in Module 3
+ * print the same fields so the files can be concatenated.
+ *
+ * --types picks the element types: int8 and int16 inputs accumulate into int32 C, float and double
+ * accumulate in themselves. Strassen is only run for int32, float and double.
+ * --sparsity zeroes that percentage of the inputs, the sparse variant (sparse.h) then picks the dense,
+ * SpMM or SpGEMM path from the measured density and reports it in the kernel column. The csr variant
+ * multiplies the CSR forms of the inputs into a CSR C (adaptiveSparseMultiply), so on the SpGEMM path
+ * memory follows the non zeros, and checks C element by element against the dense blocked result.
+ * --pin=compact|scatter binds the pool workers and OpenMP threads to CPUs (affinity.h); the inputs
+ * are first touched by each thread count's own team so their pages sit on the right NUMA nodes.
+ *
+ * To compile:
+ * $ g++ -O3 -fopenmp MatrixBenchmark.cpp -lpthread -o MatrixBenchmark
+ *
+ * To run:
+ * $ ./MatrixBenchmark --sizes=256,512,1024,2048 --threads=1,2,4,8 --warmup=1 --reps=5 --format=csv > results.csv
+ * $ ./MatrixBenchmark --variants=openmp,strassen --sizes=4096 --threads=8 --format=json
+ * $ ./MatrixBenchmark --variants=sequential,openmp --types=int8,int16,int32,float --sizes=2048 --threads=4
+ * $ ./MatrixBenchmark --variants=openmp,sparse --sparsity=97 --sizes=2048 --threads=4
+ * $ ./MatrixBenchmark --variants=sparse,csr --sparsity=99 --sizes=8192 --threads=4
+ * $ ./MatrixBenchmark --variants=pthread,openmp --pin=scatter --sizes=4096 --threads=16,32
+ */
+
+#include <iostream>
+#include <omp.h>
+#include "matrix.h"
+#include "gemm.h"
+#include "poolGemm.h"
+#include "strassen.h"
+#include "sparse.h"
+#include "affinity.h"
+#include "benchmark.h"
+#include "verify.h"
+
+using namespace std;
+
+template <typename T>
+void intialiseArray(BasicMatrix<T> &array, int sparsity) {
+	for (int i = 0; i < array.rows; i++)
+	{
+		for (int j = 0; j < array.cols; j++)
+		{
+			array[i][j] = (T)(rand() % ((100 - 1) + 1) + 1);
+			if (sparsity > 0 && rand() % 100 < sparsity) array[i][j] = 0;
+		}
+	}
+}		//intialises array with random values, 1..100 fits every element type, about sparsity percent are zeroed
+
+bool wanted(const char *variants, const char *name)
+{
+	const char *found = strstr(variants, name);
+	size_t length = strlen(name);
+	while (found) {
+		bool starts = found == variants || found[-1] == ',';
+		bool ends = found[length] == '\0' || found[length] == ',';
+		if (starts && ends) return true;
+		found = strstr(found + 1, name);
+	}
+	return false;
+}		//true when name is one of the comma separated variants
+
+struct BenchOptions {
+	std::vector<int> threads;
+	int warmup;
+	int reps;
+	int seed;
+	const char *format;
+	const char *variants;
+	BlockSizes blocks;
+	int cutoff;			//Strassen cutoff
+	int rounds;			//Freivalds rounds after each variant, 0 to skip
+	unsigned verifySeed;		//seed of the Freivalds vectors, separate from the fixed input seed
+	int sparsity;			//percentage of input elements set to zero
+	PinMode pin;
+	std::vector<int> cpus;		//pinning order, detected once before any thread is bound
+};
+
+template <typename In, typename Acc>
+void report(BenchResult result, bool pinned, const BenchOptions &opt, const BasicMatrix<In> &A, const BasicMatrix<In> &B, const BasicMatrix<Acc> &C)
+{
+	result.type = elementTypeName<In>();
+	result.pinning = pinModeName(pinned ? opt.pin : PIN_NONE);
+	if (opt.rounds > 0) result.verified = freivaldsVerify(A, B, C, opt.rounds, opt.verifySeed) ? 1 : 0;
+	printBenchResult(stdout, opt.format, result);
+}		//C is zeroed before each variant, so a variant that skips part of C cannot pass on an earlier result
+
+template <typename In, typename Acc>
+void createInputs(int n, const BenchOptions &opt, BasicMatrix<In> &A, BasicMatrix<In> &B, BasicMatrix<Acc> &C)
+{
+	A = createMatrixOf<In>(n, n);
+	B = createMatrixOf<In>(n, n);
+	C = createMatrixOf<Acc>(n, n);
+	firstTouch(A, opt.blocks.mc);
+	firstTouch(B, opt.blocks.mc);
+	firstTouch(C, opt.blocks.mc);
+	srand(opt.seed);
+	intialiseArray(A, opt.sparsity);
+	intialiseArray(B, opt.sparsity);
+}		//pages are placed by the current OpenMP team, then filled with the same values for every team
+
+template <typename In, typename Acc>
+void freeInputs(BasicMatrix<In> &A, BasicMatrix<In> &B, BasicMatrix<Acc> &C)
+{
+	freeMatrix(A);
+	freeMatrix(B);
+	freeMatrix(C);
+}
+
+template <typename In, typename Acc>
+void benchmarkSize(int n, const BenchOptions &opt)
+{
+	const char *kernel = MicroKernelFor<In, Acc>::name;
+	BasicMatrix<In> A, B;
+	BasicMatrix<Acc> C;
+
+	omp_set_num_threads(1);
+	bool pinned = pinOpenmpThreads(opt.cpus);
+	createInputs(n, opt, A, B, C);
+	zeroMatrix(C);
+	vector<double> samples = timeRepetitions(opt.warmup, opt.reps, [&]() { blockedMatrixMultiply(A, B, C, 0, n, opt.blocks); });
+	BenchResult baseline = summarise("sequential", n, 1, kernel, opt.warmup, samples, 0);
+	baseline.efficiency = 1;
+	if (wanted(opt.variants, "sequential")) report(baseline, pinned, opt, A, B, C);
+	freeInputs(A, B, C);
+
+	for (size_t t = 0; t < opt.threads.size(); t++) {
+		int numThreads = opt.threads[t];
+		omp_set_num_threads(numThreads);
+		pinned = pinOpenmpThreads(opt.cpus);
+		createInputs(n, opt, A, B, C);
+
+		if (wanted(opt.variants, "pthread")) {
+			ThreadPool *pool = createThreadPool(numThreads, opt.cpus.data(), (int)opt.cpus.size());
+			zeroMatrix(C);
+			samples = timeRepetitions(opt.warmup, opt.reps, [&]() { poolMatrixMultiply(pool, A, B, C, opt.blocks); });
+			report(summarise("pthread", n, numThreads, kernel, opt.warmup, samples, baseline.median), pool->pinned == numThreads, opt, A, B, C);
+			destroyThreadPool(pool);
+		}
+
+		if (wanted(opt.variants, "openmp")) {
+			zeroMatrix(C);
+			samples = timeRepetitions(opt.warmup, opt.reps, [&]() { openmpBlockedMatrixMultiply(A, B, C, opt.blocks); });
+			report(summarise("openmp", n, numThreads, kernel, opt.warmup, samples, baseline.median), pinned, opt, A, B, C);
+		}
+
+		if (wanted(opt.variants, "sparse")) {
+			const char *path = "dense";
+			zeroMatrix(C);
+			samples = timeRepetitions(opt.warmup, opt.reps, [&]() { path = adaptiveMatrixMultiply(A, B, C, opt.blocks); });
+			report(summarise("sparse", n, numThreads, path, opt.warmup, samples, baseline.median), pinned, opt, A, B, C);
+		}		//the kernel column names the path the density check picked, density counting is timed too
+
+		if (wanted(opt.variants, "csr")) {
+			CsrMatrix<In> sparseA = csrFromDense(A), sparseB = csrFromDense(B);
+			CsrMatrix<Acc> sparseC = createCsr<Acc>(0, 0, 0);
+			const char *path = "spgemm-csr";
+			samples = timeRepetitions(opt.warmup, opt.reps, [&]() {
+				freeCsr(sparseC);
+				path = adaptiveSparseMultiply(sparseA, sparseB, sparseC, opt.blocks);
+			});
+			BenchResult result = summarise("csr", n, numThreads, path, opt.warmup, samples, baseline.median);
+			result.type = elementTypeName<In>();
+			result.pinning = pinModeName(pinned ? opt.pin : PIN_NONE);
+			if (opt.rounds > 0) {
+				openmpBlockedMatrixMultiply(A, B, C, opt.blocks);
+				result.verified = csrMatchesDense(sparseC, C, n) ? 1 : 0;
+			}
+			printBenchResult(stdout, opt.format, result);
+			freeCsr(sparseA);
+			freeCsr(sparseB);
+			freeCsr(sparseC);
+		}		//inputs are converted outside the timed region, the dense reference is only built for the check
+
+		if constexpr (std::is_same<In, Acc>::value) {
+			if (wanted(opt.variants, "strassen")) {
+				StrassenOptions sopt = defaultStrassenOptions(numThreads);
+				sopt.cutoff = opt.cutoff;
+				sopt.bs = opt.blocks;
+				zeroMatrix(C);
+				samples = timeRepetitions(opt.warmup, opt.reps, [&]() { strassenMatrixMultiply(A, B, C, sopt); });
+				report(summarise("strassen", n, numThreads, kernel, opt.warmup, samples, baseline.median), pinned, opt, A, B, C);
+			}
+		}		//the narrow types have no Strassen, its operand sums would overflow them
+
+		freeInputs(A, B, C);
+	}		//fresh inputs per thread count, so first touch matches the team that multiplies them
+}		//every wanted variant at one size and element type, against that type's own sequential baseline
+
+int main(int argc, char *argv[]){
+
+	vector<int> sizes = parseList(argc, argv, "--sizes", "256,512,1024");
+	BenchOptions opt;
+	opt.threads = parseList(argc, argv, "--threads", "1,2,4");
+	opt.warmup = parseOption(argc, argv, "--warmup", 1);
+	opt.reps = parseOption(argc, argv, "--reps", 5);
+	opt.seed = parseOption(argc, argv, "--seed", 1);
+	opt.format = parseString(argc, argv, "--format", "csv");
+	opt.variants = parseString(argc, argv, "--variants", "sequential,pthread,openmp,strassen");
+	const char *types = parseString(argc, argv, "--types", "int32");
+
+	BlockSizes blocks = defaultBlockSizes();
+	blocks.mc = parseOption(argc, argv, "--mc", blocks.mc);
+	blocks.kc = parseOption(argc, argv, "--kc", blocks.kc);
+	blocks.nc = parseOption(argc, argv, "--nc", blocks.nc);
+	opt.blocks = checkBlockSizes(blocks);
+	opt.cutoff = parseOption(argc, argv, "--strassen", 512);
+	opt.rounds = parseOption(argc, argv, "--verify", VERIFY_DEFAULT_ROUNDS);
+	opt.verifySeed = verifySeed(argc, argv);
+	opt.sparsity = parseOption(argc, argv, "--sparsity", 0);
+	opt.pin = parsePinMode(argc, argv, PIN_NONE);
+	opt.cpus = pinOrder(opt.pin);
+
+	if (sizes.empty() || opt.threads.empty() || opt.reps < 1) {
+		cerr<<"usage: "<<argv[0]<<" [--sizes=256,512] [--threads=1,2,4] [--warmup=1] [--reps=5] [--seed=1] [--format=csv|json]"<<endl;
+		cerr<<"\t[--variants=sequential,pthread,openmp,sparse,csr,strassen] [--types=int8,int16,int32,float,double]"<<endl;
+		cerr<<"\t[--mc=rows] [--kc=depth] [--nc=cols] [--strassen=cutoff] [--verify=rounds] [--verify-seed=n] [--sparsity=percent]"<<endl;
+		cerr<<"\t[--pin=none|compact|scatter]"<<endl;
+		exit(-1);
+	}
+
+	if (opt.rounds > 0) cerr<<"verify seed: "<<opt.verifySeed<<" (--verify-seed= repeats it)"<<endl;		//stderr, stdout stays CSV / JSON
+	printBenchHeader(stdout, opt.format);
+
+	for (size_t s = 0; s < sizes.size(); s++) {
+		if (wanted(types, "int8")) benchmarkSize<int8_t, int>(sizes[s], opt);
+		if (wanted(types, "int16")) benchmarkSize<int16_t, int>(sizes[s], opt);
+		if (wanted(types, "int32")) benchmarkSize<int, int>(sizes[s], opt);
+		if (wanted(types, "float")) benchmarkSize<float, float>(sizes[s], opt);
+		if (wanted(types, "double")) benchmarkSize<double, double>(sizes[s], opt);
+	}
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* OutOfCoreMatrixMultiplication.cpp
+ *
+ * Multiplies matrices that are kept in files rather than in memory (outOfCore.h), so N is limited by
+ * disk space instead of RAM. A and B are written straight into mapped files, then C = A * B is run
+ * tile by tile through the same blocked kernels as SequentialMatrixMultiplication() and
+ * OpenmpMatrixMultiplication() in ParallelMatrixMultiplication.cpp, with a prefetch thread reading
+ * the next tiles while the current ones are multiplied.
+ *
+ * usage: OutOfCoreMatrixMultiplication <threads> [N] [--dir=path] [--tile=edge] [--verify=rounds] [--verify-seed=n] [--keep=1]
+ *	--dir	where A.mat, B.mat and C.mat are written, the current directory by default
+ *	--tile	tile edge, the working set is five tile x tile int tiles (default 2048, 80 MB)
+ *	--keep	leave the files behind instead of deleting them
+ */
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <omp.h>
+#include "matrix.h"
+#include "gemm.h"
+#include "benchmark.h"
+#include "verify.h"
+#include "outOfCore.h"
+
+using namespace std;
+
+#define DEFAULT_N 4000
+int N;
+int NUM_THREADS;
+BlockSizes blocks;			//cache block sizes for the blocked kernel inside each tile
+int VERIFY_ROUNDS;			//Freivalds rounds run on each result, streamed from the files
+unsigned VERIFY_SEED;			//seed of the Freivalds vectors, printed so --verify-seed= can repeat a failure
+
+void intialiseArray(Matrix &array) {
+	cout<<"intialising array... ";
+	for (int i = 0; i < N; i++)
+	{
+		for (int j = 0; j < N; j++)
+		{
+			array[i][j] = rand() % ((100 - 1) + 1) + 1;
+		}
+	}
+	cout<<"complete"<<endl;
+}		//intialises array with random values through the mapping, the page cache writes it to the file
+
+void SequentialTileMultiply(const Matrix &A, const Matrix &B, Matrix &C, bool accumulate)
+{
+	blockedMatrixMultiply(A, B, C, 0, A.rows, blocks, accumulate);
+}		//the sequential cache blocked kernel on one resident tile
+
+void OpenmpTileMultiply(const Matrix &A, const Matrix &B, Matrix &C, bool accumulate)
+{
+	openmpBlockedMatrixMultiply(A, B, C, blocks, accumulate);
+}		//the OpenMP cache blocked kernel on one resident tile
+
+void runOutOfCore(const char *name, MatrixFile &a, MatrixFile &b, MatrixFile &c, int tile, TileMultiply multiply)
+{
+	zeroMatrix(c.m);		//each variant starts from zero so stale results cannot pass verification
+	cout<<name<<"\tTime elapsed: ";
+	double start = wallTime();
+	OutOfCoreStats stats = outOfCoreMultiply(a.m, b.m, c.m, tile, multiply);
+	double elapsed = wallTime() - start;
+
+	cout<<elapsed * 1000<<"ms\tI/O wait: "<<stats.waitSeconds * 1000<<"ms\tread: "<<stats.bytesRead / 1e9<<" GB";
+	if (VERIFY_ROUNDS > 0) cout<<(freivaldsVerify(a.m, b.m, c.m, VERIFY_ROUNDS, VERIFY_SEED) ? "\tverified" : "\tFAILED verification");
+	cout<<endl;
+}		//one timed out-of-core multiply, verification streams A, B and C from the files outside the timed region
+
+int main(int argc, char *argv[]){
+
+	if(argc < 2){
+		cout<<"please restart the application with an argument for the desired number of threads (consider hardware maximum)"<<endl;
+		cout<<"usage: "<<argv[0]<<" <threads> [N] [--dir=path] [--tile=edge] [--verify=rounds] [--verify-seed=n] [--keep=1]"<<endl;
+		exit(-1);
+	}
+
+	NUM_THREADS = atoi(argv[1]);		//pull argv value for threads
+	N = parseSize(argc, argv, 2, DEFAULT_N);		//optional argv value for the array size
+	string dir = parseString(argc, argv, "--dir", ".");
+	int tile = parseOption(argc, argv, "--tile", OUT_OF_CORE_TILE);
+	bool keep = parseOption(argc, argv, "--keep", 0) != 0;
+	VERIFY_ROUNDS = parseOption(argc, argv, "--verify", VERIFY_DEFAULT_ROUNDS);
+	VERIFY_SEED = verifySeed(argc, argv);
+	blocks = defaultBlockSizes();
+	omp_set_num_threads(NUM_THREADS);
+
+	string pathA = dir + "/A.mat", pathB = dir + "/B.mat", pathC = dir + "/C.mat";
+	MatrixFile a = createMatrixFile(pathA.c_str(), N, N);
+	MatrixFile b = createMatrixFile(pathB.c_str(), N, N);
+	MatrixFile c = createMatrixFile(pathC.c_str(), N, N);
+
+	cout<<"Array size (N x N) is: "<<N<<"\ttile: "<<tile<<"\tmicro kernel: "<<microKernelName<<"\tfiles: "<<3.0 * a.mapBytes / 1e9<<" GB in "<<dir<<"\tverify seed: "<<VERIFY_SEED<<endl;
+	intialiseArray(a.m);
+	intialiseArray(b.m);
+
+	runOutOfCore("Out-of-core Sequential Matrix Multiplication.", a, b, c, tile, SequentialTileMultiply);
+	runOutOfCore(("Out-of-core OpenMP Matrix Multiplication with " + to_string(NUM_THREADS) + " threads.").c_str(), a, b, c, tile, OpenmpTileMultiply);
+
+	closeMatrixFile(a);
+	closeMatrixFile(b);
+	closeMatrixFile(c);
+	if (!keep) {
+		unlink(pathA.c_str());
+		unlink(pathB.c_str());
+		unlink(pathC.c_str());
+	}
+
+	return 0;
+}
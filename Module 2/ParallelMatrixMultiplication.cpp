@@ -3,6 +3,7 @@
  * 8/4/19
  *
  * This program creates 2 random arrays of n size and multiplies them together in a sequential, pthread and OpenMP method.
+ * It times a single run of each, use MatrixBenchmark.cpp for repeated runs with percentiles and CSV/JSON output.
  */
 //#include "pch.h"
 
@@ -12,33 +13,48 @@
 #include <time.h>
 #include <pthread.h>
 #include <omp.h>
+#include "matrix.h"
+#include "gemm.h"
+#include "poolGemm.h"
+#include "strassen.h"
+#include "sparse.h"
+#include "affinity.h"
+#include "verify.h"
 
 using namespace std;
 
-#define N 1000
+#define DEFAULT_N 1000
 //#define NUM_THREADS 2
-//int N;
+int N;
 int NUM_THREADS;
 
 pthread_mutex_t mutx;
-
-int inputArray1[N][N];
-int inputArray2[N][N];
-int outputArray[N][N];
-
-void intialiseArray(int array[N][N]) {
+ThreadPool *pool;			//created once in main and reused by every pthread multiply
+BlockSizes blocks;			//cache block sizes for the blocked kernel, --mc= --kc= --nc= on the command line
+StrassenOptions strassen;		//Strassen mode runs only when --strassen=<cutoff> is given
+int VERIFY_ROUNDS;			//Freivalds rounds run on each result, --verify=0 turns the check off
+unsigned VERIFY_SEED;			//seed of the Freivalds vectors, printed so --verify-seed= can repeat a failure
+int SPARSITY;				//percentage of input elements set to zero, --sparsity= on the command line
+PinMode PIN;				//thread to core binding, --pin=compact|scatter on the command line
+
+Matrix inputArray1;
+Matrix inputArray2;
+Matrix outputArray;
+
+void intialiseArray(Matrix &array) {
 	cout<<"intialising array... ";
 	for (int i = 0; i < N; i++)
 	{
 		for (int j = 0; j < N; j++)
 		{
 			array[i][j] = rand() % ((100 - 1) + 1) + 1;
+			if (SPARSITY > 0 && rand() % 100 < SPARSITY) array[i][j] = 0;
 		}
 	}
 	cout<<"complete"<<endl;
-}		//intialises array with random values, uses the N global variable
+}		//intialises array with random values, uses the N global variable and zeroes about SPARSITY percent of them
 
-void printArrays(int array[N][N]){
+void printArrays(const Matrix &array){
 	cout <<"[";
 	for (int i = 0; i < N; i++) {
 		cout << "[";
@@ -53,103 +69,88 @@ void printArrays(int array[N][N]){
 
 void SequentialMatrixMultiplication()
 {
-	int value;
-	for (int i = 0; i < N; i++)
-	{
-		for (int j = 0; j < N; j++)
-		{
-			value = 0;
-			for (int k = 0; k < N; k++)
-			{
-				value += inputArray1[i][k] * inputArray2[k][j];
-			}
-			outputArray[i][j] = value;
-
-		}
-	}
-}		//performs a sequential matrix mutiplication
+	blockedMatrixMultiply(inputArray1, inputArray2, outputArray, 0, N, blocks);
+}		//performs a sequential cache blocked matrix mutiplication
 
-void *pthreadMatrixMultiplication(void *threadid)
+void pthreadMatrixMultiplication()
 {
-	long tid = (long)threadid;
-	long value;
-
-	int range = N/NUM_THREADS;
-	int start = tid * range;
-	int end = start + range;
-
-	//pthread_mutex_lock(&mutx);
-	//cout<<tid<<":"<<start<<"-"<<end<<endl;
-	//pthread_mutex_unlock(&mutx);
-
-	for (int i = start ; i < end ; i++)
-	{
-		for (int j = 0; j < N; j++)
-		{
-			value = 0;
-			for (int k = 0; k < N; k++)
-			{
-				value += inputArray1[i][k] * inputArray2[k][j];
-			}
-
-			//pthread_mutex_lock(&mutx);
-			outputArray[i][j] = value;
-			//pthread_mutex_unlock(&mutx);
-		}
-	}
-	//cout<<"Done"<<endl;
-	pthread_exit(NULL);
-}		//performs a threaded matrix multiplication using the global NUM_THREADS value
+	poolMatrixMultiply(pool, inputArray1, inputArray2, outputArray, blocks);
+}		//performs a threaded matrix multiplication on the persistent pool, tiles are work stolen between the NUM_THREADS workers
 
 void OpenmpMatrixMultiplication()
 {
-	//int value;
-	//#pragma omp parallel num_threads(NUM_THREADS) private(value)					//uncheck with line 119 also unchecked
-	//i could use a shared variable for the array was not global
-	#pragma omp parallel
-	{
-		//cout<<omp_get_thread_num()<<endl;
-		//int value;
-		#pragma omp for
-		for (int i = 0; i < N; i++)
-		{
-			for (int j = 0; j < N; j++)
-			{	
+	openmpBlockedMatrixMultiply(inputArray1, inputArray2, outputArray, blocks);
+}		//performs a threaded cache blocked matrix multiplication using OpenMP 
 
-				int value = 0;
-				//#pragma omp for 					//uncheck with line 107 also unchecked
-				//#pragma omp parallel for reduction(+: value) num_threads(NUM_THREADS)
-				for (int k = 0; k < N; k++)
-				{
-					value += inputArray1[i][k] * inputArray2[k][j];
-				}
+const char *SparseMatrixMultiplication()
+{
+	return adaptiveMatrixMultiply(inputArray1, inputArray2, outputArray, blocks);
+}		//measures the density of the inputs and runs the dense OpenMP, SpMM or SpGEMM multiply, returns which
 
-				//#pragma omp atmoic update			//not really required
-				outputArray[i][j] = value;
+const char *CsrMatrixMultiplication(CsrMatrix<int> &sparseC)
+{
+	CsrMatrix<int> sparseA = csrFromDense(inputArray1), sparseB = csrFromDense(inputArray2);
+	const char *path = adaptiveSparseMultiply(sparseA, sparseB, sparseC, blocks);
+	freeCsr(sparseA);
+	freeCsr(sparseB);
+	return path;
+}		//the same choice on CSR copies of the inputs with a CSR result, conversion included in the time
+
+void StrassenMatrixMultiplication()
+{
+	strassenMatrixMultiply(inputArray1, inputArray2, outputArray, strassen);
+}		//performs a Strassen-Winograd matrix multiplication, sub-products run as OpenMP tasks
 
-			}
-		}
-	}
-}		//performs a threaded matrix multiplication using OpenMP 
+const char *verifyOutput()
+{
+	if (VERIFY_ROUNDS < 1) return "";
+	return freivaldsVerify(inputArray1, inputArray2, outputArray, VERIFY_ROUNDS, VERIFY_SEED) ? "\tverified" : "\tFAILED verification";
+}		//O(N^2) probabilistic check of outputArray, run outside the timed region
 
 int main(int argc, char *argv[]){
 
 	if(argc < 2){
 		cout<<"please restart the application with an argument for the desired number of threads (consider hardware maximum)"<<endl;
+		cout<<"usage: "<<argv[0]<<" <threads> [N] [--mc=rows] [--kc=depth] [--nc=cols] [--strassen=cutoff] [--taskdepth=levels] [--verify=rounds] [--verify-seed=n] [--sparsity=percent] [--pin=none|compact|scatter]"<<endl;
 		exit(-1);
 	}
 
 	NUM_THREADS = atoi(argv[1]);		//pull argv value for threads
-	//N = atoi(argv[2]);
+	N = parseSize(argc, argv, 2, DEFAULT_N);		//optional argv value for the array size
+
+	blocks = defaultBlockSizes();
+	blocks.mc = parseOption(argc, argv, "--mc", blocks.mc);
+	blocks.kc = parseOption(argc, argv, "--kc", blocks.kc);
+	blocks.nc = parseOption(argc, argv, "--nc", blocks.nc);
+	blocks = checkBlockSizes(blocks);
+
+	strassen = defaultStrassenOptions(NUM_THREADS);
+	strassen.cutoff = parseOption(argc, argv, "--strassen", 0);
+	strassen.taskDepth = parseOption(argc, argv, "--taskdepth", strassen.taskDepth);
+	strassen.bs = blocks;
+	VERIFY_ROUNDS = parseOption(argc, argv, "--verify", VERIFY_DEFAULT_ROUNDS);
+	VERIFY_SEED = verifySeed(argc, argv);
+	SPARSITY = parseOption(argc, argv, "--sparsity", 0);
+	PIN = parsePinMode(argc, argv, PIN_NONE);
+	vector<int> cpus = pinOrder(PIN);		//read before any thread is bound, binding narrows the affinity mask
+
+	inputArray1 = createMatrix(N, N);
+	inputArray2 = createMatrix(N, N);
+	outputArray = createMatrix(N, N);
 
 	struct timeval timecheck;
 	
-	pthread_t threads[NUM_THREADS];
 	pthread_mutex_init(&mutx, NULL);
+	pool = createThreadPool(NUM_THREADS, cpus.data(), (int)cpus.size());
 
 	omp_set_num_threads(NUM_THREADS);
+	bool pinned = pinOpenmpThreads(cpus) && pool->pinned == NUM_THREADS;
+
+	firstTouch(inputArray1, blocks.mc);
+	firstTouch(inputArray2, blocks.mc);
+	firstTouch(outputArray, blocks.mc);		//places each thread's row blocks on its own NUMA node before the serial fill
 
-	cout<<"Array size (N x N) is: "<<N<<endl;
+	cout<<"Array size (N x N) is: "<<N<<"\tmicro kernel: "<<microKernelName<<"\tpinning: "<<pinModeName(pinned ? PIN : PIN_NONE)<<"\tverify seed: "<<VERIFY_SEED<<endl;
 	intialiseArray(inputArray1);
 	intialiseArray(inputArray2);
 
@@ -162,6 +163,7 @@ int main(int argc, char *argv[]){
 	//cout << "Output Array"<<endl;
 	//printArrays(outputArray);
 
+	zeroMatrix(outputArray);		//each variant starts from zero so stale results cannot pass verification
 	cout<<"Sequential Matrix Multiplication.\t\tTime elapsed: ";
 
 	gettimeofday(&timecheck, NULL);
@@ -174,32 +176,28 @@ int main(int argc, char *argv[]){
 	long timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
 
 	double time_elapsed = timeofday_end - timeofday_start;
-	cout<<time_elapsed<<"ms"<<endl;
+	cout<<time_elapsed<<"ms"<<verifyOutput()<<endl;
 	//cout << "Output Array"<<endl;
 	//printArrays(outputArray);
 
+	zeroMatrix(outputArray);
 	cout<<"pthread Matrix Multiplication with " << NUM_THREADS << " threads.\tTime elapsed: ";
 
 	gettimeofday(&timecheck, NULL);
 
 	timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
 
-	for (long tid = 0 ; tid < NUM_THREADS;tid++){
-		pthread_create(&threads[tid], NULL, pthreadMatrixMultiplication, (void *)tid);
-	}
-
-	for (long tid = 0 ; tid < NUM_THREADS;tid++){
-		pthread_join(threads[tid], NULL);
-	}
+	pthreadMatrixMultiplication();
 
 	gettimeofday(&timecheck, NULL);
 	timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
 
 	time_elapsed = timeofday_end - timeofday_start;
-	cout<<time_elapsed<<"ms"<<endl;
+	cout<<time_elapsed<<"ms"<<verifyOutput()<<endl;
 	//cout << "Output Array"<<endl;
 	//printArrays(outputArray);
 
+	zeroMatrix(outputArray);
 	cout<<"OpenMP Matrix Multiplication with " << NUM_THREADS << " threads.\tTime elapsed: ";
 
 	gettimeofday(&timecheck, NULL);
@@ -212,9 +210,67 @@ int main(int argc, char *argv[]){
 	timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
 
 	time_elapsed = timeofday_end - timeofday_start;
-	cout<<time_elapsed<<"ms"<<endl;
+	cout<<time_elapsed<<"ms"<<verifyOutput()<<endl;
+	//cout << "Output Array"<<endl;
+	//printArrays(outputArray);
+
+	zeroMatrix(outputArray);
+	cout<<"Adaptive Matrix Multiplication with " << NUM_THREADS << " threads.\tTime elapsed: ";
+
+	gettimeofday(&timecheck, NULL);
+
+	timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+
+	const char *path = SparseMatrixMultiplication();
+
+	gettimeofday(&timecheck, NULL);
+	timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+
+	time_elapsed = timeofday_end - timeofday_start;
+	cout<<time_elapsed<<"ms ("<<path<<")"<<verifyOutput()<<endl;
+
+	CsrMatrix<int> sparseC;
+	cout<<"CSR Matrix Multiplication with " << NUM_THREADS << " threads.\tTime elapsed: ";
+
+	gettimeofday(&timecheck, NULL);
+
+	timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+
+	path = CsrMatrixMultiplication(sparseC);
+
+	gettimeofday(&timecheck, NULL);
+	timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+
+	time_elapsed = timeofday_end - timeofday_start;
+	cout<<time_elapsed<<"ms ("<<path<<", "<<sparseC.nnz<<" non zeros)";
+	if (VERIFY_ROUNDS > 0) cout<<(csrMatchesDense(sparseC, outputArray, N) ? "\tmatches adaptive result" : "\tDIFFERS from adaptive result");
+	cout<<endl;		//outputArray still holds the adaptive result, checked by Freivalds above
+	freeCsr(sparseC);
+
+	if (strassen.cutoff > 0) {
+		zeroMatrix(outputArray);
+		cout<<"Strassen Matrix Multiplication with " << NUM_THREADS << " threads.\tTime elapsed: ";
+
+		gettimeofday(&timecheck, NULL);
+
+		timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+
+		StrassenMatrixMultiplication();
+
+		gettimeofday(&timecheck, NULL);
+		timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+
+		time_elapsed = timeofday_end - timeofday_start;
+		cout<<time_elapsed<<"ms"<<verifyOutput()<<endl;
+	}
+
 	//cout << "Output Array"<<endl;
 	//printArrays(outputArray);
 
+	destroyThreadPool(pool);
+	freeMatrix(inputArray1);
+	freeMatrix(inputArray2);
+	freeMatrix(outputArray);
+
 	return 0;
 }
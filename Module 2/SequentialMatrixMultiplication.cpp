@@ -5,14 +5,19 @@
 #include <iostream>
 #include <random>
 #include <time.h>
+#include "matrix.h"
+#include "gemm.h"
+#include "benchmark.h"
 
-#define n 1000
+#define DEFAULT_N 1000
 
-int inputArray1[n][n];
-int inputArray2[n][n];
-int OutputArray[n][n];
+int n;
 
-void printArrays(int array1[n][n], int array2[n][n], int arrayOut[n][n])
+Matrix inputArray1;
+Matrix inputArray2;
+Matrix OutputArray;
+
+void printArrays(const Matrix &array1, const Matrix &array2, const Matrix &arrayOut)
 {
 	//std::cout << "Hello World!\n";
 	std::cout << "Input Array 1\n[";
@@ -53,7 +58,7 @@ void printArrays(int array1[n][n], int array2[n][n], int arrayOut[n][n])
 
 }
 
-void intialiseArray(int array[n][n]) {
+void intialiseArray(Matrix &array) {
 	for (int i = 0; i < n; i++)
 	{
 		for (int j = 0; j < n; j++)
@@ -64,27 +69,19 @@ void intialiseArray(int array[n][n]) {
 
 }
 
-void SequentialMatrixMultiplication(int array1[n][n], int array2[n][n], int arrayOut[n][n])
+void SequentialMatrixMultiplication(const Matrix &array1, const Matrix &array2, Matrix &arrayOut)
 {
-	int value;
-	for (int i = 0; i < n; i++)
-	{
-		for (int j = 0; j < n; j++)
-		{
-			value = 0;
-			for (int k = 0; k < n; k++)
-			{
-				value += array1[i][k] * array2[k][j];
-			}
-			arrayOut[i][j] = value;
-
-		}
-	}
+	blockedMatrixMultiply(array1, array2, arrayOut, 0, n, defaultBlockSizes());
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-	clock_t start, stop;
+	n = parseSize(argc, argv, 1, DEFAULT_N);		//optional argv value for the array size
+
+	inputArray1 = createMatrix(n, n);
+	inputArray2 = createMatrix(n, n);
+	OutputArray = createMatrix(n, n);
+
 	//int n = rand() % ((100 - 1) + 1) + 1; //not allowed in C++ language
 //	int inputArray1[n][n];
 //	int inputArray2[n][n];
@@ -94,17 +91,18 @@ int main()
 		intialiseArray(inputArray1);
 		intialiseArray(inputArray2);
 
-		int start_s = clock();
+		double start_s = wallTime();		//wall time, clock() would count CPU time
 		SequentialMatrixMultiplication(inputArray1, inputArray2, OutputArray);
-		int stop_s = clock();
-
-		//std::cout << "Runtime is: " << (stop_s - start_s) / double(CLOCKS_PER_SEC) * 1000 << "ms" << std::endl;
+		double stop_s = wallTime();
 
 		//printArrays(inputArray1, inputArray2, OutputArray);
 
-		std::cout << "Runtime is: " << (stop_s - start_s) / double(CLOCKS_PER_SEC) * 1000 << "ms" << std::endl;
+		std::cout << "Runtime is: " << (stop_s - start_s) * 1000 << "ms" << std::endl;
 	}
 
+	freeMatrix(inputArray1);
+	freeMatrix(inputArray2);
+	freeMatrix(OutputArray);
 }
 
 
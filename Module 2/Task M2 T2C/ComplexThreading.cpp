@@ -4,25 +4,69 @@
  * 
  * This program generates a random array of LENGTH and sorts it seqentualy and in parallel
  * this program requires qSort.o to compile, makefile is included, use the comman below for simplest build and run
-g++ -fopenmp ComplexThreading.cpp qSort.o
-*/
+g++ -O2 -fopenmp ComplexThreading.cpp qSort.o
+ *
+ * usage: ./a.out [threads] [length] [--cutoff=n] [--parallel-min=n]
+ *	threads	pthreads and OpenMP threads, every core by default
+ *	length	ints in the array, 10^6 to 10^9 is where the parallel sorts pay off
+ *	--cutoff	ranges shorter than this are sorted sequentially by one thread or task, at least INSERTION_THRESHOLD
+ *	--parallel-min	ranges at least this long are split by parallelPartition3, 2^20 by default
+ *
+ * The pthread sort keeps a deque of ranges per thread. A thread partitions its range, queues the larger
+ * half on its own deque and keeps partitioning the smaller half; when its deque is empty it steals the
+ * oldest range from another thread, so a bad pivot only moves work between threads instead of idling them.
+ * Threads with nothing to do sleep on a condition variable. A thread that takes a range of PARALLEL_MIN
+ * or more offers it to them as a parallelPartition3() job, so the idle pool threads share the O(n) pass
+ * instead of waiting for it; the OpenMP sort does the same for its team with tasks.
+ */
 
 #include "qSort.h"
 #include <iostream>
 #include <random>
+#include <string.h>
 #include <sys/time.h>
 #include <omp.h>
 #include <pthread.h> 
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <algorithm>
 
 using namespace std;
 
-#define LENGTH 10  //60000
-int Array[LENGTH];
-int NUM_THREADS = 2;
-int P;
-
-void initArray(int array[LENGTH]){
-	srand (time(NULL));
+#define DEFAULT_LENGTH 1000000
+#define DEFAULT_CUTOFF 10000		//a few thousand elements keeps task overhead well under the sorting work
+#define PRINT_LIMIT 20			//arrays longer than this are not printed
+int LENGTH;
+int *Array;
+int NUM_THREADS;
+int CUTOFF;
+int PARALLEL_MIN;			//ranges at least this long are partitioned by every thread at once
+unsigned int SEED;			//every sort gets the same input
+
+struct SortRange {
+	int first;
+	int last;
+};
+
+struct SortDeque {
+	deque<SortRange> ranges;		//the owner works at the back, thieves take from the front
+	pthread_mutex_t mutx;
+};
+
+struct PartitionJob {
+	BlockPartition *bp;
+	int helpers;			//pool threads inside blockPartitionWorker, guarded by SortMutx
+};
+
+vector<SortDeque> Deques;		//one per pthread
+atomic<int> Outstanding;		//ranges queued or being sorted, the threads stop when it reaches zero
+pthread_mutex_t SortMutx;		//guards Jobs and the idle threads' wait
+pthread_cond_t SortChanged;		//a range was queued, a job was offered or finished, or the sort is done
+vector<PartitionJob *> Jobs;		//block partitions the idle pool threads can join
+
+void initArray(int array[]){
+	srand (SEED);
 	cout<<"Using Array of size: "<<LENGTH<<endl;
 	cout<<"Initialising Array with random values...\t";
 	for (int i = 0 ; i < LENGTH ; i++){
@@ -32,7 +76,8 @@ void initArray(int array[LENGTH]){
 
 }			//intialises array with random values
 
-void printArray(int array[LENGTH]){
+void printArray(int array[]){
+	if (LENGTH > PRINT_LIMIT) return;
 	cout<<"[";
 	for (int i = 0 ; i < LENGTH ; i++){
 		cout<<array[i]<<", ";
@@ -40,116 +85,243 @@ void printArray(int array[LENGTH]){
 	cout<<"]\n";
 }			//prints array to the console
 
-void openmpQuickSort( int array[], int first, int last ) 
+bool isSorted(int array[]){
+	for (int i = 1 ; i < LENGTH ; i++){
+		if (array[i - 1] > array[i]) return false;
+	}
+	return true;
+}			//checks the sort result in one pass
+
+void openmpBlockWorkers(BlockPartition &bp)
 {
-    int pivotElement;
- 
-    if(first < last)
+    for (int t = 0; t < omp_get_num_threads(); t++)
     {
-        pivotElement = pivot(array, first, last);
-        //#pragma omp parallel sections
-        //{
-        //	#pragma omp section
-        	quickSort(array, first, pivotElement-1);
-        	//cout<<"1"<<endl;
-
-        	//#pragma omp section
-        	quickSort(array, pivotElement+1, last);
-        	//cout<<"2"<<endl;
-    	//}
+        #pragma omp task shared(bp)
+        blockPartitionWorker(bp);
     }
-}		//non functioning OpenMP attempt causes compiler error
+    #pragma omp taskwait
+}		//a task per thread in the team, idle threads pick them up while this one waits
 
-void* pthread_QuickSort(void *threadid){
+void openmpQuickSortTask( int array[], int first, int last ) 
+{
+    if(last - first < 1)
+        return;
+    if(last - first < CUTOFF)
+    {
+        quickSort(array, first, last);
+        return;
+    }
 
-	int pivotElement;
+    Partition p = last - first + 1 >= PARALLEL_MIN && omp_get_num_threads() > 1 ? parallelPartition3(array, first, last, openmpBlockWorkers) : partition3(array, first, last);
 
-	long tid = (long)threadid;
- 	int range = LENGTH/NUM_THREADS;
-	
- 	int first = tid * range;;
- 	int last = first + range - 1;
+    #pragma omp task
+    openmpQuickSortTask(array, first, p.lt-1);
 
- 	if(tid == 0){
+    #pragma omp task
+    openmpQuickSortTask(array, p.gt+1, last);
+}		//each partition hands its two halves to the team as tasks, long ranges are partitioned by the whole team and short ones sorted sequentially
 
-		last = P - 1 ;
+void openmpQuickSort( int array[], int first, int last ) 
+{
+    #pragma omp parallel
+    #pragma omp single nowait
+    openmpQuickSortTask(array, first, last);
+}		//one parallel region for the whole sort, the barrier at its end waits for every task
+
+void pushRange(long tid, int first, int last){
+	if (first >= last) return;
+	Outstanding++;			//counted before it is visible, so no thread sees zero while it is queued
+	pthread_mutex_lock(&Deques[tid].mutx);
+	Deques[tid].ranges.push_back(SortRange{ first, last });
+	pthread_mutex_unlock(&Deques[tid].mutx);
+
+	pthread_mutex_lock(&SortMutx);
+	pthread_cond_broadcast(&SortChanged);
+	pthread_mutex_unlock(&SortMutx);
+}		//queues a range on the back of this thread's deque and wakes the idle threads
+
+void finishRange(){
+	if (--Outstanding > 0) return;
+	pthread_mutex_lock(&SortMutx);
+	pthread_cond_broadcast(&SortChanged);
+	pthread_mutex_unlock(&SortMutx);
+}		//the last range to finish releases every waiting thread
+
+bool takeRange(long tid, SortRange &range){
+	for (int i = 0; i < NUM_THREADS; i++){
+		long victim = (tid + i) % NUM_THREADS;
+		SortDeque &d = Deques[victim];
+		pthread_mutex_lock(&d.mutx);
+		bool found = !d.ranges.empty();
+		if (found && victim == tid){
+			range = d.ranges.back();
+			d.ranges.pop_back();
+		}else if (found){
+			range = d.ranges.front();
+			d.ranges.pop_front();
+		}
+		pthread_mutex_unlock(&d.mutx);
+		if (found) return true;
+	}
+	return false;
+}		//own deque first from the back, newest and still in cache, then steals the oldest and largest range from the others
+
+void poolBlockWorkers(BlockPartition &bp){
+	PartitionJob job = { &bp, 0 };
+
+	pthread_mutex_lock(&SortMutx);
+	Jobs.push_back(&job);
+	pthread_cond_broadcast(&SortChanged);
+	pthread_mutex_unlock(&SortMutx);
+
+	blockPartitionWorker(bp);
+
+	pthread_mutex_lock(&SortMutx);
+	Jobs.erase(find(Jobs.begin(), Jobs.end(), &job));
+	while (job.helpers > 0) pthread_cond_wait(&SortChanged, &SortMutx);
+	pthread_mutex_unlock(&SortMutx);
+}		// offers the partition to the idle pool threads, works on it too, then waits for the helpers to leave
+
+bool nextRange(long tid, SortRange &range){
+	pthread_mutex_lock(&SortMutx);
+	while (true){
+		PartitionJob *job = NULL;
+		for (size_t j = 0; j < Jobs.size() && !job; j++)
+			if (Jobs[j]->bp->remaining > 0) job = Jobs[j];
+
+		if (job){
+			job->helpers++;
+			pthread_mutex_unlock(&SortMutx);
+			blockPartitionWorker(*job->bp);
+			pthread_mutex_lock(&SortMutx);
+			if (--job->helpers == 0) pthread_cond_broadcast(&SortChanged);
+			continue;
+		}		//helping a partition in progress comes first, the whole pool waits on it
+
+		if (takeRange(tid, range)){
+			pthread_mutex_unlock(&SortMutx);
+			return true;
+		}
+		if (Outstanding == 0) break;
+		pthread_cond_wait(&SortChanged, &SortMutx);
+	}
+	pthread_mutex_unlock(&SortMutx);
+	return false;
+}		//blocks until there is a partition to help with or a range to sort, false once everything is sorted
 
-	    if(first < last)
-	    {
-	        pivotElement = pivot(Array, first, last);
-	        quickSort(Array, first, pivotElement-1);
-	        quickSort(Array, pivotElement+1, last);
-	    }
-	}else{
+void* pthread_QuickSort(void *threadid){
 
-		first = P;
+	long tid = (long)threadid;
+	SortRange range;
 
-	    if(first < last)
+	while (nextRange(tid, range)){
+	    while (range.last - range.first >= max(CUTOFF, 1))
 	    {
-	        pivotElement = pivot(Array, first, last);
-	        quickSort(Array, first, pivotElement-1);
-	        quickSort(Array, pivotElement+1, last);
-	    }
+	        bool wide = NUM_THREADS > 1 && range.last - range.first + 1 >= PARALLEL_MIN;
+	        Partition p = wide ? parallelPartition3(Array, range.first, range.last, poolBlockWorkers) : partition3(Array, range.first, range.last);
+	        if (p.lt - range.first > range.last - p.gt){
+	            pushRange(tid, range.first, p.lt-1);
+	            range.first = p.gt+1;
+	        }else{
+	            pushRange(tid, p.gt+1, range.last);
+	            range.last = p.lt-1;
+	        }
+	    }		//the larger half is left for thieves, this thread carries on with the smaller one
+	    quickSort(Array, range.first, range.last);
+	    finishRange();
 	}
-}		//Generates values for the threads to begin the recursion
+	return NULL;
+}		//each thread splits ranges until they are under CUTOFF, long ones with the help of the idle threads
 
 
 void pthreadQuickSort(){
 
-	pthread_t threads[NUM_THREADS];
+	vector<pthread_t> threads(NUM_THREADS);
+	Deques = vector<SortDeque>(NUM_THREADS);
+	for (int tid = 0; tid < NUM_THREADS; tid++)
+		pthread_mutex_init(&Deques[tid].mutx, NULL);
+	pthread_mutex_init(&SortMutx, NULL);
+	pthread_cond_init(&SortChanged, NULL);
 
-    	P = pivot(Array, 0, LENGTH-1);			//global P
+	Outstanding = 0;
+	pushRange(0, 0, LENGTH-1);			//thread 0 starts with the whole array, the rest help partition it and then steal
 
 		for (long tid = 0; tid < NUM_THREADS; tid++) 
 			pthread_create(&threads[tid], NULL, pthread_QuickSort, (void *)tid);
 
 		for (long tid = 0; tid < NUM_THREADS; tid++) 
 			pthread_join(threads[tid], NULL); 
-}		// identification of the piviot and creation of the thread
 
-int main(int argc, char *argv[]){
+	for (int tid = 0; tid < NUM_THREADS; tid++)
+		pthread_mutex_destroy(&Deques[tid].mutx);
+	pthread_mutex_destroy(&SortMutx);
+	pthread_cond_destroy(&SortChanged);
+	Deques.clear();
+}		// seeds the deques and runs a thread per deque until every range is sorted
 
-	struct timeval timecheck;
-	//NUM_THREADS = atoi(argv[1]);
+void sequentialSort(){
+	quickSort(Array, 0, LENGTH-1);
+}
 
-	initArray(Array);
-	//printArray(Array);
+void stdSort(){
+	sort(Array, Array + LENGTH);
+}
 
-	cout<<"Sequential QuickSort.\t\t\t\tTime elapsed: ";
+void openmpSort(){
+	openmpQuickSort(Array, 0, LENGTH-1);
+}
 
-	gettimeofday(&timecheck, NULL);
+double timeSort(const char *name, void (*sort)()){
 
-	long timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+	struct timeval timecheck;
 
-	quickSort(Array, 0, LENGTH-1);
-	//printArray(Array);
+	initArray(Array);
+	printArray(Array);
+	cout<<name<<"\tTime elapsed: ";
 
 	gettimeofday(&timecheck, NULL);
-	long timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+	double start = timecheck.tv_sec * 1000.0 + timecheck.tv_usec / 1000.0;
 
-	double time_elapsed = timeofday_end - timeofday_start;
-	cout<<time_elapsed<<"ms"<<endl;
+	sort();
 
-	
-	initArray(Array);
+	gettimeofday(&timecheck, NULL);
+	double time_elapsed = timecheck.tv_sec * 1000.0 + timecheck.tv_usec / 1000.0 - start;
+
+	cout<<time_elapsed<<"ms"<<(isSorted(Array) ? "" : "\tNOT SORTED")<<endl;
 	printArray(Array);
-	cout<<"pthread QuickSort.\t\t\t\tTime elapsed: ";
+	return time_elapsed;
+}		//sorts a fresh copy of the input and returns the time in ms
 
-	gettimeofday(&timecheck, NULL);
+int main(int argc, char *argv[]){
 
-	timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+	NUM_THREADS = argc > 1 && atoi(argv[1]) > 0 ? atoi(argv[1]) : omp_get_num_procs();
+	LENGTH = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : DEFAULT_LENGTH;
+	CUTOFF = DEFAULT_CUTOFF;
+	PARALLEL_MIN = PARALLEL_PARTITION_MIN;
+	for (int i = 1 ; i < argc ; i++){
+		if (strncmp(argv[i], "--cutoff=", 9) == 0) CUTOFF = atoi(argv[i] + 9);
+		if (strncmp(argv[i], "--parallel-min=", 15) == 0) PARALLEL_MIN = atoi(argv[i] + 15);
+	}
+	if (CUTOFF < INSERTION_THRESHOLD){
+		cerr<<"--cutoff below "<<INSERTION_THRESHOLD<<" only adds tasks for ranges insertion sort finishes anyway, using "<<INSERTION_THRESHOLD<<endl;
+		CUTOFF = INSERTION_THRESHOLD;
+	}		//also keeps 0, negative and unparsable values away from partition3, which needs first < last
+	omp_set_num_threads(NUM_THREADS);
 
-	//pthread_QuickSort((void*)NULL);
-	pthreadQuickSort();
-	
+	SEED = time(NULL);
+	Array = new int[LENGTH];
 
-	gettimeofday(&timecheck, NULL);
-	timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+	double sequential = timeSort("Sequential QuickSort.\t\t\t", sequentialSort);
+	double library = timeSort("std::sort.\t\t\t\t", stdSort);
+	cout<<"QuickSort time relative to std::sort: "<<sequential / library<<endl;
 
-	time_elapsed = timeofday_end - timeofday_start;
-	cout<<time_elapsed<<"ms"<<endl;
+	cout<<"cutoff: "<<CUTOFF<<"\tparallel partition from: "<<PARALLEL_MIN<<endl;
+	double pthread = timeSort(("pthread QuickSort with " + to_string(NUM_THREADS) + " threads.\t").c_str(), pthreadQuickSort);
+	cout<<"speedup: "<<sequential / pthread<<endl;
 
-	printArray(Array);
+	double openmp = timeSort(("OpenMP task QuickSort with " + to_string(NUM_THREADS) + " threads.").c_str(), openmpSort);
+	cout<<"speedup: "<<sequential / openmp<<endl;
 
+	delete[] Array;
 	return 0;
 }
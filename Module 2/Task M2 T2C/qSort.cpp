@@ -4,6 +4,24 @@
  * 
  * foundation code from https://gsamaras.wordpress.com/code/quicksort-c/
  *
+ * The original Lomuto pivot() always partitioned around array[first], so sorted input and long runs
+ * of equal keys (rand()%100 gives every key thousands of times in a large array) made quickSort()
+ * O(n^2). partition3() groups every key equal to the pivot in the middle, where it is never touched
+ * again, and the pivot is a median of samples so sorted and reversed input split evenly.
+ *
+ * quickSort() is an introsort on top of it: it recurses into the smaller side and loops on the larger,
+ * finishes ranges under INSERTION_THRESHOLD with insertion sort, and hands a range to heapSort() once
+ * it has been partitioned 2 log2 n times, so neither the time nor the stack depth can degrade.
+ *
+ * parallelPartition3() splits a long range with several threads, in the style of Tsigas and Zhang's
+ * parallel quicksort. Every thread claims one PARTITION_BLOCK block from the front and one from the
+ * back and swaps misplaced keys between them until one block is clean, then claims another on that
+ * side, until no blocks are left. At most one block per thread and side is left unfinished; the
+ * finished blocks are swapped outwards past them and one thread partitions what is left in the
+ * middle, at most two blocks per thread plus the remainder. Two such passes, keys < pivot and then
+ * keys == pivot, give the same bands as partition3(). The threads come from the caller, so the
+ * pthread and OpenMP sorts can both use it.
+ *
  * to make for ComplexThreading.cpp:
 
 $g++ -c qSort.cpp
@@ -11,6 +29,7 @@ $g++ -c qSort.cpp
 */
 
 #include <iostream>
+#include <algorithm>
 #include "./qSort.h"
 
 using namespace std;
@@ -22,33 +41,274 @@ void swap(int& a, int& b)
     b = temp;
 }
 
-int pivot(int array[], int first, int last) 
+int median3(int array[], int a, int b, int c)
+{
+    if (array[a] < array[b])
+        return array[b] < array[c] ? b : (array[a] < array[c] ? c : a);
+    return array[a] < array[c] ? a : (array[b] < array[c] ? c : b);
+}		//index of the median of three elements
+
+int choosePivot(int array[], int first, int last)
 {
-    int  p = first;
+    int n = last - first + 1;
+    int mid = first + n / 2;
+    if (n <= NINTHER_THRESHOLD)
+        return median3(array, first, mid, last);
+
+    int step = n / 8;
+    int a = median3(array, first, first + step, first + 2 * step);
+    int b = median3(array, mid - step, mid, mid + step);
+    int c = median3(array, last - 2 * step, last - step, last);
+    return median3(array, a, b, c);
+}		//index of the pivot: median of three, or the ninther over nine spread samples
+
+Partition partition3(int array[], int first, int last)
+{
+    swap(array[first], array[choosePivot(array, first, last)]);
     int pivotElement = array[first];
- 
-    for(int i = first+1 ; i <= last ; i++)
+    int i = first, j = last + 1;
+    int p = first, q = last + 1;		//keys equal to the pivot collect in [first, p] and [q, last]
+    if (array[last] < pivotElement)
+    {
+        swap(array[first], array[last]);
+        i = p = first - 1;
+        j = q = last;
+    }		//either way an element >= pivot ends the range and one <= pivot starts it, so neither scan needs a bounds check
+
+    while (true)
     {
-        if(array[i] <= pivotElement)
+        while (array[++i] < pivotElement) ;
+        while (pivotElement < array[--j]) ;
+        if (i >= j)
         {
-            p++;
-            swap(array[i], array[p]);
+            if (i == j)
+                swap(array[++p], array[i]);		//scans met on a key equal to the pivot
+            break;
         }
+        swap(array[i], array[j]);
+        if (array[i] == pivotElement) swap(array[++p], array[i]);
+        if (array[j] == pivotElement) swap(array[--q], array[j]);
     }
- 
-    swap(array[p], array[first]);
- 
-    return p;
+
+    i = j + 1;
+    for (int k = first; k <= p; k++) swap(array[k], array[j--]);
+    for (int k = last; k >= q; k--) swap(array[k], array[i++]);
+    return Partition{ j + 1, i - 1 };
+}		//Bentley-McIlroy fat partition: Hoare scans park equal keys at both ends, which are then swapped into the middle
+
+template <bool Inclusive>
+inline bool goesLeft(int value, int pivotElement)
+{
+    return Inclusive ? value <= pivotElement : value < pivotElement;
 }
 
-void quickSort( int array[], int first, int last ) 
+template <bool Inclusive>
+int partitionRange(int array[], int first, int last, int pivotElement)
 {
-    int pivotElement;
- 
-    if(first < last)
+    while (true)
+    {
+        while (first <= last && goesLeft<Inclusive>(array[first], pivotElement))
+            first++;
+        while (first <= last && !goesLeft<Inclusive>(array[last], pivotElement))
+            last--;
+        if (first >= last)
+            return first;
+        swap(array[first++], array[last--]);
+    }
+}		//two way Hoare partition, returns the first index of the right side
+
+void startBlockPartition(BlockPartition &bp, int array[], int first, int last, int pivotElement, bool inclusive)
+{
+    bp.array = array;
+    bp.first = first;
+    bp.last = last;
+    bp.pivotElement = pivotElement;
+    bp.inclusive = inclusive;
+    bp.blocks = (last - first + 1) / PARTITION_BLOCK;
+    bp.remaining = bp.blocks;
+    bp.leftClaimed = 0;
+    bp.rightClaimed = 0;
+    bp.done.assign(bp.blocks, 0);
+}		//array[first .. last] split around pivotElement, by < or by <= when inclusive
+
+int claimBlock(BlockPartition &bp, std::atomic<int> &claimed)
+{
+    if (bp.remaining.fetch_sub(1) <= 0)
+        return -1;
+    return claimed.fetch_add(1);
+}		//the next block from one side, -1 once both sides have met
+
+template <bool Inclusive>
+void neutraliseBlocks(BlockPartition &bp)
+{
+    int left = claimBlock(bp, bp.leftClaimed);
+    int right = claimBlock(bp, bp.rightClaimed);
+    int i = 0, j = 0;
+
+    while (left >= 0 && right >= 0)
+    {
+        int *l = bp.array + bp.first + left * PARTITION_BLOCK;
+        int *r = bp.array + bp.last + 1 - (right + 1) * PARTITION_BLOCK;
+        while (i < PARTITION_BLOCK && goesLeft<Inclusive>(l[i], bp.pivotElement))
+            i++;
+        while (j < PARTITION_BLOCK && !goesLeft<Inclusive>(r[j], bp.pivotElement))
+            j++;
+
+        if (i == PARTITION_BLOCK)
+        {
+            bp.done[left] = 1;
+            left = claimBlock(bp, bp.leftClaimed);
+            i = 0;
+        }
+        else if (j == PARTITION_BLOCK)
+        {
+            bp.done[bp.blocks - 1 - right] = 1;
+            right = claimBlock(bp, bp.rightClaimed);
+            j = 0;
+        }
+        else
+            swap(l[i++], r[j++]);
+    }
+}		//blocks are numbered from the front, so left and right blocks never share a done flag
+
+void blockPartitionWorker(BlockPartition &bp)
+{
+    if (bp.inclusive)
+        neutraliseBlocks<true>(bp);
+    else
+        neutraliseBlocks<false>(bp);
+}		//any number of threads may run this at once, each returns when every block is claimed
+
+int gatherDoneBlocks(BlockPartition &bp, int claimed, bool front)
+{
+    int done = 0;
+    for (int k = 0; k < claimed; k++)
+        done += bp.done[front ? k : bp.blocks - 1 - k];
+
+    for (int k = 0, m = done; k < done; k++)
+    {
+        if (bp.done[front ? k : bp.blocks - 1 - k])
+            continue;
+        while (!bp.done[front ? m : bp.blocks - 1 - m])
+            m++;
+        int *outer = front ? bp.array + bp.first + k * PARTITION_BLOCK : bp.array + bp.last + 1 - (k + 1) * PARTITION_BLOCK;
+        int *inner = front ? bp.array + bp.first + m * PARTITION_BLOCK : bp.array + bp.last + 1 - (m + 1) * PARTITION_BLOCK;
+        std::swap_ranges(outer, outer + PARTITION_BLOCK, inner);
+        m++;
+    }
+    return done;
+}		//moves one side's finished blocks to its outer end, returns how many there are
+
+int finishBlockPartition(BlockPartition &bp)
+{
+    int left = gatherDoneBlocks(bp, bp.leftClaimed, true);
+    int right = gatherDoneBlocks(bp, bp.rightClaimed, false);
+    int first = bp.first + left * PARTITION_BLOCK;
+    int last = bp.last - right * PARTITION_BLOCK;
+    return bp.inclusive ? partitionRange<true>(bp.array, first, last, bp.pivotElement) : partitionRange<false>(bp.array, first, last, bp.pivotElement);
+}		//after the workers: the unfinished blocks and the remainder are partitioned on this thread, returns the first index of the right side
+
+Partition parallelPartition3(int array[], int first, int last, BlockWorkers workers)
+{
+    int pivotElement = array[choosePivot(array, first, last)];
+    BlockPartition bp;
+
+    startBlockPartition(bp, array, first, last, pivotElement, false);
+    workers(bp);
+    int lt = finishBlockPartition(bp);
+
+    startBlockPartition(bp, array, lt, last, pivotElement, true);
+    workers(bp);
+    int gt = finishBlockPartition(bp) - 1;
+
+    return Partition{ lt, gt };
+}		//the bands of partition3(), keys < pivot split off first and then keys == pivot from the rest
+
+void insertionSort(int array[], int first, int last)
+{
+    int smallest = first;
+    for (int i = first + 1; i <= last; i++)
+        smallest = array[i] < array[smallest] ? i : smallest;
+    swap(array[first], array[smallest]);		//a sentinel, so the inner loop needs no bounds check
+
+    for (int i = first + 2; i <= last; i++)
+    {
+        int value = array[i];
+        int j = i;
+        while (value < array[j - 1])
+        {
+            array[j] = array[j - 1];
+            j--;
+        }
+        array[j] = value;
+    }
+}		//sorts a short range, the minimum goes first and then stops every shift
+
+void siftDown(int array[], int first, int root, int n)
+{
+    int value = array[first + root];
+    int child;
+    while ((child = 2 * root + 1) < n)
+    {
+        if (child + 1 < n && array[first + child] < array[first + child + 1])
+            child++;
+        if (array[first + child] <= value)
+            break;
+        array[first + root] = array[first + child];
+        root = child;
+    }
+    array[first + root] = value;
+}		//max heap over array[first .. first+n-1], root counted from first
+
+void heapSort(int array[], int first, int last)
+{
+    int n = last - first + 1;
+    for (int root = n / 2 - 1; root >= 0; root--)
+        siftDown(array, first, root, n);
+    for (int end = n - 1; end > 0; end--)
     {
-        pivotElement = pivot(array, first, last);
-        quickSort(array, first, pivotElement-1);
-        quickSort(array, pivotElement+1, last);
+        swap(array[first], array[first + end]);
+        siftDown(array, first, 0, end);
     }
-}
\ No newline at end of file
+}		//O(n log n) whatever the input, the fallback when quicksort keeps picking bad pivots
+
+int depthLimit(int n)
+{
+    int depth = 0;
+    for (; n > 1; n >>= 1)
+        depth++;
+    return 2 * depth;
+}		//2 floor(log2 n) partitions before a range is handed to heapSort
+
+void introSort(int array[], int first, int last, int depth)
+{
+    while (last - first >= INSERTION_THRESHOLD)
+    {
+        if (depth-- == 0)
+        {
+            heapSort(array, first, last);
+            return;
+        }
+
+        Partition p = partition3(array, first, last);
+        if (p.lt - first < last - p.gt)
+        {
+            introSort(array, first, p.lt-1, depth);
+            first = p.gt+1;
+        }
+        else
+        {
+            introSort(array, p.gt+1, last, depth);
+            last = p.lt-1;
+        }
+    }		//recursing on the smaller side keeps the stack under log2 n frames
+
+    if (first < last)
+        insertionSort(array, first, last);
+}
+
+void quickSort( int array[], int first, int last ) 
+{
+    if(first < last)
+        introSort(array, first, last, depthLimit(last - first + 1));
+}		//introsort: quicksort with a depth limit, heapsort past it and insertion sort on short ranges
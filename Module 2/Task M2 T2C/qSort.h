@@ -1,6 +1,55 @@
 /* https://gsamaras.wordpress.com/code/quicksort-c/
-*/
+ *
+ * partition3() is the partition every quicksort in ComplexThreading.cpp uses: a fat (three-way)
+ * partition around a median-of-three pivot, or Tukey's ninther on longer ranges, and quickSort() is an
+ * introsort built on it.
+ *
+ * parallelPartition3() gives the same three bands for ranges long enough that one thread partitioning
+ * them would hold the others up: the range is cut into PARTITION_BLOCK blocks that the caller's
+ * threads claim from both ends and partition against each other, see qSort.cpp.
+ */
+
+#ifndef QSORT_H
+#define QSORT_H
+
+#include <atomic>
+#include <vector>
+
+#define NINTHER_THRESHOLD 40		//ranges longer than this take the median of three medians of three
+#define INSERTION_THRESHOLD 32		//ranges shorter than this are finished by insertion sort
+#define PARTITION_BLOCK 4096		//ints per block in parallelPartition3, 16 KB stays in L1
+#define PARALLEL_PARTITION_MIN (1 << 20)	//ranges shorter than this are cheaper to partition3 on one thread
+
+struct Partition {
+	int lt;			//array[first .. lt-1] < pivot
+	int gt;			//array[lt .. gt] == pivot, array[gt+1 .. last] > pivot
+};
+
+struct BlockPartition {
+	int *array;
+	int first;
+	int last;
+	int pivotElement;
+	bool inclusive;			//keys equal to the pivot go left as well
+	int blocks;			//whole blocks in the range, the remainder sits between the two sides
+	std::atomic<int> remaining;	//blocks neither side has claimed yet
+	std::atomic<int> leftClaimed;	//blocks claimed from the front
+	std::atomic<int> rightClaimed;	//blocks claimed from the back
+	std::vector<unsigned char> done;	//per block, set once every key in it is on the right side
+};
+
+typedef void (*BlockWorkers)(BlockPartition &bp);		//runs blockPartitionWorker(bp) on every thread and returns when they are finished
 
 void swap(int& a, int& b);
-int pivot(int array[], int first, int last) ;
-void quickSort( int array[], int first, int last ) ;
\ No newline at end of file
+int choosePivot(int array[], int first, int last);
+Partition partition3(int array[], int first, int last);
+void startBlockPartition(BlockPartition &bp, int array[], int first, int last, int pivotElement, bool inclusive);
+void blockPartitionWorker(BlockPartition &bp);
+int finishBlockPartition(BlockPartition &bp);
+Partition parallelPartition3(int array[], int first, int last, BlockWorkers workers);
+void insertionSort(int array[], int first, int last);
+void heapSort(int array[], int first, int last);
+void introSort(int array[], int first, int last, int depth);
+void quickSort( int array[], int first, int last ) ;
+
+#endif
@@ -0,0 +1,198 @@
+/* affinity.h
+ *
+ * NUMA placement helpers for the shared memory multiplies: CPU topology from /sys, thread to core
+ * pinning for the pthread pool and the OpenMP team, and parallel first touch of matrices.
+ *
+ * Linux places a page on the NUMA node of the thread that first writes it, so a matrix initialised
+ * by one thread ends up entirely on that thread's socket. firstTouch zeroes the rows in parallel with
+ * the same static row block split the OpenMP multiply uses, so each block of A and C starts out on the
+ * node of the thread that will work on it; the random values are written afterwards by one thread
+ * into pages that are already placed.
+ *
+ * Pinning orders the CPUs this process may run on (sched_getaffinity) in one of two ways:
+ *
+ *	compact		fill one node before the next, one thread per physical core before any
+ *			SMT sibling is used, keeps a small team on one socket's caches and memory
+ *	scatter		round robin over the nodes, spreads memory bandwidth over every socket
+ *
+ * and thread i is bound to the i-th CPU of that order (wrapping around when there are more threads).
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include "matrix.h"
+
+enum PinMode { PIN_NONE, PIN_COMPACT, PIN_SCATTER };
+
+struct CpuInfo {
+	int cpu;
+	int node;
+	int package;
+	int core;			//core_id, shared by SMT siblings of one package
+	int sibling;			//0 for the first hardware thread of a core, 1 for the next ...
+};
+
+inline const char *pinModeName(PinMode mode)
+{
+	return mode == PIN_COMPACT ? "compact" : (mode == PIN_SCATTER ? "scatter" : "none");
+}
+
+inline PinMode parsePinMode(int argc, char *argv[], PinMode fallback)
+{
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--pin=", 6) != 0) continue;
+		const char *mode = argv[i] + 6;
+		if (strcmp(mode, "compact") == 0) return PIN_COMPACT;
+		if (strcmp(mode, "scatter") == 0) return PIN_SCATTER;
+		if (strcmp(mode, "none") == 0) return PIN_NONE;
+		fprintf(stderr, "unknown --pin=%s, expected none, compact or scatter\n", mode);
+		exit(1);
+	}
+	return fallback;
+}		//reads --pin=none|compact|scatter from argv, a misspelt mode stops the run instead of benchmarking unpinned
+
+inline int readSysInt(const char *path, int fallback)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) return fallback;
+	int value;
+	if (fscanf(f, "%d", &value) != 1) value = fallback;
+	fclose(f);
+	return value;
+}		//one integer from a sysfs file, fallback when the file is missing
+
+inline std::vector<int> readCpuList(const char *path)
+{
+	std::vector<int> cpus;
+	FILE *f = fopen(path, "r");
+	if (!f) return cpus;
+	int first, last;
+	while (fscanf(f, "%d", &first) == 1) {
+		last = first;
+		int c = fgetc(f);
+		if (c == '-') {
+			if (fscanf(f, "%d", &last) != 1) break;
+			c = fgetc(f);
+		}
+		for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+		if (c != ',') break;
+	}
+	fclose(f);
+	return cpus;
+}		//parses a sysfs cpu list such as "0-3,8-11"
+
+inline std::vector<CpuInfo> detectTopology()
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return std::vector<CpuInfo>();
+
+	std::vector<int> nodeOf(CPU_SETSIZE, -1);
+	DIR *nodes = opendir("/sys/devices/system/node");
+	if (nodes) {
+		struct dirent *entry;
+		while ((entry = readdir(nodes)) != NULL) {
+			int node;
+			if (sscanf(entry->d_name, "node%d", &node) != 1) continue;
+			char path[512];
+			snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+			std::vector<int> cpus = readCpuList(path);
+			for (size_t i = 0; i < cpus.size(); i++) if (cpus[i] < CPU_SETSIZE) nodeOf[cpus[i]] = node;
+		}
+		closedir(nodes);
+	}		//kernels without NUMA support have no node directories, the package stands in below
+
+	std::vector<CpuInfo> topology;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed)) continue;
+		char path[256];
+		CpuInfo info;
+		info.cpu = cpu;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+		info.package = readSysInt(path, 0);
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+		info.core = readSysInt(path, cpu);
+		info.node = nodeOf[cpu] >= 0 ? nodeOf[cpu] : info.package;
+		info.sibling = 0;
+		for (size_t i = 0; i < topology.size(); i++) {
+			if (topology[i].package == info.package && topology[i].core == info.core) info.sibling++;
+		}
+		topology.push_back(info);
+	}
+	return topology;
+}		//every CPU this process may run on, with its node, package, core and SMT sibling index
+
+inline std::vector<int> pinOrder(PinMode mode)
+{
+	std::vector<CpuInfo> topology = detectTopology();
+	std::vector<int> order;
+	if (mode == PIN_NONE || topology.empty()) return order;
+
+	std::sort(topology.begin(), topology.end(), [](const CpuInfo &a, const CpuInfo &b) {
+		if (a.sibling != b.sibling) return a.sibling < b.sibling;
+		if (a.node != b.node) return a.node < b.node;
+		if (a.package != b.package) return a.package < b.package;
+		return a.cpu < b.cpu;
+	});		//physical cores first, node by node
+
+	if (mode == PIN_COMPACT) {
+		std::stable_sort(topology.begin(), topology.end(), [](const CpuInfo &a, const CpuInfo &b) { return a.node < b.node; });
+		for (size_t i = 0; i < topology.size(); i++) order.push_back(topology[i].cpu);
+		return order;
+	}		//within each node the SMT siblings stay after the physical cores
+
+	std::vector<std::vector<int> > perNode;
+	std::vector<int> nodeIds;
+	for (size_t i = 0; i < topology.size(); i++) {
+		size_t n = std::find(nodeIds.begin(), nodeIds.end(), topology[i].node) - nodeIds.begin();
+		if (n == nodeIds.size()) {
+			nodeIds.push_back(topology[i].node);
+			perNode.push_back(std::vector<int>());
+		}
+		perNode[n].push_back(topology[i].cpu);
+	}
+	for (size_t k = 0; order.size() < topology.size(); k++) {
+		for (size_t n = 0; n < perNode.size(); n++) if (k < perNode[n].size()) order.push_back(perNode[n][k]);
+	}
+	return order;
+}		//CPUs in the order threads are bound to them, empty for PIN_NONE
+
+inline bool pinThread(int cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}		//binds the calling thread to one CPU
+
+inline bool pinOpenmpThreads(const std::vector<int> &order)
+{
+	if (order.empty()) return false;
+	int pinned = 0;
+	#pragma omp parallel reduction(+:pinned)
+	pinned += pinThread(order[omp_get_thread_num() % order.size()]);
+	return pinned == omp_get_max_threads();
+}		//binds each thread of the OpenMP team, libgomp reuses the same threads for later regions of the same size
+
+template <typename T>
+inline void firstTouch(BasicMatrix<T> &m, int blockRows)
+{
+	if (blockRows < 1) blockRows = 1;
+	#pragma omp parallel for schedule(static)
+	for (int ib = 0; ib < m.rows; ib += blockRows) {
+		int end = ib + blockRows < m.rows ? ib + blockRows : m.rows;
+		memset(m[ib], 0, (size_t)(end - ib) * m.stride * sizeof(T));
+	}
+}		//zeroes the matrix in blocks of blockRows rows with the same static split as the OpenMP multiply's row loop
+
+#endif
@@ -0,0 +1,147 @@
+/* benchmark.h
+ *
+ * Wall clock timing and reporting shared by the matrix multiplication programs.
+ * A benchmark runs some warm up repetitions that are thrown away, then times each repetition
+ * separately and reports the median with the 10th and 90th percentiles, so single noisy runs do not
+ * decide a comparison. Results are printed as CSV rows or JSON lines with the same fields:
+ *
+ *	variant, n, workers, kernel, type, pinning, warmup, reps, median_ms, p10_ms, p90_ms, gops, efficiency, verified
+ *
+ * gops counts 2 * n^3 operations (one multiply and one add per term) for every variant, Strassen
+ * included, whatever the element type, and efficiency is the sequential median / (median * workers), left empty without a baseline.
+ * pinning is compact or scatter when every worker was bound to a CPU (affinity.h), otherwise none.
+ * verified is the Freivalds check from verify.h on the last repetition's output, empty when not checked.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+struct BenchResult {
+	std::string variant;
+	int n;
+	int workers;			//threads, ranks or ranks * threads
+	std::string kernel;
+	std::string type;		//element type of A and B, int32 unless the program says otherwise
+	std::string pinning;		//none, compact or scatter
+	int warmup;
+	int reps;
+	double median;			//milliseconds
+	double p10;
+	double p90;
+	double gops;
+	double efficiency;		//negative when there is no sequential baseline
+	int verified;			//1 passed, 0 failed, -1 not checked
+};
+
+inline double wallTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}		//seconds from a monotonic clock, unlike clock() it counts wall time not CPU time
+
+inline double percentile(std::vector<double> samples, double fraction)
+{
+	if (samples.empty()) return 0;
+	std::sort(samples.begin(), samples.end());
+	double position = fraction * (samples.size() - 1);
+	size_t below = (size_t)position;
+	if (below + 1 >= samples.size()) return samples.back();
+	double weight = position - below;
+	return samples[below] * (1 - weight) + samples[below + 1] * weight;
+}		//linear interpolation between the two closest ranks
+
+template <typename Body>
+std::vector<double> timeRepetitions(int warmup, int reps, Body body)
+{
+	std::vector<double> samples;
+	for (int i = 0; i < warmup; i++) body();
+	for (int i = 0; i < reps; i++) {
+		double start = wallTime();
+		body();
+		samples.push_back((wallTime() - start) * 1000);
+	}
+	return samples;
+}		//runs body warmup times untimed, then reps times, returns each repetition in ms
+
+inline BenchResult summarise(const char *variant, int n, int workers, const char *kernel, int warmup, const std::vector<double> &samples, double baselineMs)
+{
+	BenchResult r;
+	r.variant = variant;
+	r.n = n;
+	r.workers = workers;
+	r.kernel = kernel;
+	r.type = "int32";
+	r.pinning = "none";
+	r.warmup = warmup;
+	r.reps = (int)samples.size();
+	r.median = percentile(samples, 0.5);
+	r.p10 = percentile(samples, 0.1);
+	r.p90 = percentile(samples, 0.9);
+	r.gops = r.median > 0 ? 2.0 * n * n * (double)n / (r.median * 1e6) : 0;
+	r.efficiency = baselineMs > 0 && r.median > 0 ? baselineMs / (r.median * workers) : -1;
+	r.verified = -1;
+	return r;
+}
+
+inline void printBenchHeader(FILE *out, const char *format)
+{
+	if (strcmp(format, "csv") == 0) fprintf(out, "variant,n,workers,kernel,type,pinning,warmup,reps,median_ms,p10_ms,p90_ms,gops,efficiency,verified\n");
+}		//JSON lines need no header
+
+inline void printBenchResult(FILE *out, const char *format, const BenchResult &r)
+{
+	char efficiency[32] = "";
+	if (r.efficiency >= 0) snprintf(efficiency, sizeof(efficiency), "%.3f", r.efficiency);
+	const char *verified = r.verified < 0 ? "" : (r.verified ? "true" : "false");
+
+	if (strcmp(format, "json") == 0) {
+		fprintf(out, "{\"variant\":\"%s\",\"n\":%d,\"workers\":%d,\"kernel\":\"%s\",\"type\":\"%s\",\"pinning\":\"%s\",\"warmup\":%d,\"reps\":%d,"
+			"\"median_ms\":%.3f,\"p10_ms\":%.3f,\"p90_ms\":%.3f,\"gops\":%.3f,\"efficiency\":%s,\"verified\":%s}\n",
+			r.variant.c_str(), r.n, r.workers, r.kernel.c_str(), r.type.c_str(), r.pinning.c_str(), r.warmup, r.reps,
+			r.median, r.p10, r.p90, r.gops, r.efficiency >= 0 ? efficiency : "null", r.verified < 0 ? "null" : verified);
+	} else {
+		fprintf(out, "%s,%d,%d,%s,%s,%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%s,%s\n",
+			r.variant.c_str(), r.n, r.workers, r.kernel.c_str(), r.type.c_str(), r.pinning.c_str(), r.warmup, r.reps,
+			r.median, r.p10, r.p90, r.gops, efficiency, verified);
+	}
+	fflush(out);
+}
+
+inline std::vector<int> parseList(int argc, char *argv[], const char *name, const char *fallback)
+{
+	const char *text = fallback;
+	size_t length = strlen(name);
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') text = argv[i] + length + 1;
+	}
+
+	std::vector<int> values;
+	while (*text) {
+		char *end;
+		long value = strtol(text, &end, 10);
+		if (end == text) break;
+		if (value > 0) values.push_back((int)value);
+		text = *end == ',' ? end + 1 : end;
+	}
+	return values;
+}		//reads a --name=1,2,3 list from argv
+
+inline const char *parseString(int argc, char *argv[], const char *name, const char *fallback)
+{
+	size_t length = strlen(name);
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') return argv[i] + length + 1;
+	}
+	return fallback;
+}		//reads a --name=text option from argv
+
+#endif
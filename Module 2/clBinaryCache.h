@@ -0,0 +1,143 @@
+/* clBinaryCache.h
+ *
+ * On disk cache of compiled OpenCL programs, so a run only pays for clBuildProgram the first time a
+ * device sees a kernel. After a build from source the device binary is read back with
+ * CL_PROGRAM_BINARY_SIZES / CL_PROGRAM_BINARIES and written to the cache; later runs create the
+ * program with clCreateProgramWithBinary, which on CPU runtimes such as POCL is milliseconds instead
+ * of hundreds of milliseconds.
+ *
+ * An entry is keyed by everything that changes the binary: device name, vendor, driver version,
+ * OpenCL version, the build options and a hash of the source. The file name is a hash of that key and
+ * the key itself is stored at the top of the file and compared on load, so a hash collision or an
+ * entry from an older driver is rebuilt instead of used. Files are written under a temporary name and
+ * renamed into place, so ranks that start together never read a half written binary.
+ *
+ * The directory is $CL_BINARY_CACHE, else $XDG_CACHE_HOME/sit315-opencl, else ~/.cache/sit315-opencl,
+ * else /tmp/sit315-opencl; it is created when missing.
+ */
+
+#ifndef CL_BINARY_CACHE_H
+#define CL_BINARY_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <CL/cl.h>
+
+#define CL_CACHE_MAGIC "SIT315CL1"
+
+inline uint64_t fnv1a(const char *data, size_t length, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}		//64 bit FNV-1a, plenty to tell kernels apart
+
+inline std::string deviceString(cl_device_id dev, cl_uint param)
+{
+	size_t size = 0;
+	if (clGetDeviceInfo(dev, param, 0, NULL, &size) != CL_SUCCESS || size == 0) return "";
+	std::string value(size, '\0');
+	clGetDeviceInfo(dev, param, size, &value[0], NULL);
+	value.resize(strlen(value.c_str()));		//drop the terminator the runtime counts in size
+	return value;
+}
+
+inline std::string programCacheKey(cl_device_id dev, const char *source, const char *options)
+{
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a(source, strlen(source)));
+	return deviceString(dev, CL_DEVICE_NAME) + "|" + deviceString(dev, CL_DEVICE_VENDOR) + "|" + deviceString(dev, CL_DRIVER_VERSION) + "|"
+		+ deviceString(dev, CL_DEVICE_VERSION) + "|" + (options ? options : "") + "|" + hash;
+}		//one line, compared in full when an entry is loaded
+
+inline std::string programCacheDir()
+{
+	const char *dir = getenv("CL_BINARY_CACHE");
+	if (dir && *dir) return dir;
+	const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+	std::string base = xdg && *xdg ? std::string(xdg) : (home && *home ? std::string(home) + "/.cache" : std::string("/tmp"));
+	mkdir(base.c_str(), 0755);
+	return base + "/sit315-opencl";
+}
+
+inline std::string programCachePath(const std::string &key)
+{
+	std::string dir = programCacheDir();
+	mkdir(dir.c_str(), 0755);		//fails harmlessly when it is already there
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.clbin", (unsigned long long)fnv1a(key.data(), key.size()));
+	return dir + name;
+}
+
+inline bool readProgramBinary(const std::string &path, const std::string &key, std::vector<unsigned char> &binary)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f) return false;
+	std::string header = std::string(CL_CACHE_MAGIC) + "\n" + key + "\n";
+	std::vector<char> stored(header.size());
+	bool ok = fread(stored.data(), 1, stored.size(), f) == stored.size() && memcmp(stored.data(), header.data(), header.size()) == 0;
+	if (ok) {
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f) - (long)header.size();
+		fseek(f, (long)header.size(), SEEK_SET);
+		binary.resize(size > 0 ? size : 0);
+		ok = size > 0 && fread(binary.data(), 1, binary.size(), f) == binary.size();
+	}
+	fclose(f);
+	return ok;
+}		//false when the entry is missing, truncated or was written for another key
+
+inline void writeProgramBinary(cl_program program, const std::string &path, const std::string &key)
+{
+	size_t size = 0;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0) return;
+	std::vector<unsigned char> binary(size);
+	unsigned char *data = binary.data();
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, NULL) != CL_SUCCESS) return;
+
+	char temp[64];
+	snprintf(temp, sizeof(temp), ".%d.tmp", (int)getpid());
+	std::string partial = path + temp;
+	FILE *f = fopen(partial.c_str(), "wb");
+	if (!f) return;
+	bool ok = fprintf(f, "%s\n%s\n", CL_CACHE_MAGIC, key.c_str()) > 0 && fwrite(data, 1, size, f) == size;
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(partial.c_str(), path.c_str()) != 0) unlink(partial.c_str());
+}		//a cache that cannot be written only costs the next run a rebuild
+
+inline cl_program buildCachedProgram(cl_context ctx, cl_device_id dev, const char *source, const char *options, cl_int *err, bool *cached = NULL)
+{
+	std::string key = programCacheKey(dev, source, options);
+	std::string path = programCachePath(key);
+	if (cached) *cached = false;
+
+	std::vector<unsigned char> binary;
+	if (readProgramBinary(path, key, binary)) {
+		const unsigned char *bytes = binary.data();
+		size_t size = binary.size();
+		cl_int status = CL_SUCCESS;
+		cl_program program = clCreateProgramWithBinary(ctx, 1, &dev, &size, &bytes, &status, err);
+		if (*err == CL_SUCCESS && status == CL_SUCCESS && clBuildProgram(program, 1, &dev, options, NULL, NULL) == CL_SUCCESS) {
+			if (cached) *cached = true;
+			return program;
+		}
+		if (program) clReleaseProgram(program);
+	}		//an entry the runtime rejects is rebuilt from source and overwritten below
+
+	size_t length = strlen(source);
+	cl_program program = clCreateProgramWithSource(ctx, 1, &source, &length, err);
+	if (*err != CL_SUCCESS) return program;
+	*err = clBuildProgram(program, 1, &dev, options, NULL, NULL);
+	if (*err == CL_SUCCESS) writeProgramBinary(program, path, key);
+	return program;
+}		//built program for one device, *err as from clBuildProgram so the caller can still read the build log
+
+#endif
@@ -0,0 +1,195 @@
+/* gemm.h
+ *
+ * Cache blocked matrix multiplication, C = A * B, on the BasicMatrix types from matrix.h.
+ * Every entry point is a template over the input type In and the accumulator type Acc of C, and the
+ * packing layout and micro kernel come from KernelTraits<In, Acc> (int8 / int16 / int32 -> int32,
+ * float -> float, double -> double). Plain Matrix arguments deduce the int32 version.
+ * Loop order follows the GotoBLAS layout:
+ *
+ *	jc	NC columns of B at a time, the packed B block (KC x NC) is sized for L3
+ *	pc	KC deep slice of A and B, B is packed once per slice into NR wide panels
+ *	ic	MC rows of A at a time, the A block (MC x KC) is sized for L2
+ *	jr	one packed NR wide panel of B (KC x NR), sized for L1
+ *	ir	MR rows, the MR x NR tile of C is held in registers by the micro kernel
+ *
+ * Block sizes are runtime values so they can be tuned per machine without a rebuild.
+ * The micro kernel is chosen at startup from the scalar, AVX2 and AVX-512 versions in microKernel.h:
+ *	g++ -O3 -fopenmp ParallelMatrixMultiplication.cpp -lpthread
+ */
+
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "matrix.h"
+#include "microKernel.h"
+
+struct BlockSizes {
+	int mc;				//rows of A per L2 block, multiple of GEMM_MR
+	int kc;				//depth of the packed panels
+	int nc;				//columns of B per L3 block, multiple of GEMM_NR (and so of every type's NR)
+};
+
+inline BlockSizes defaultBlockSizes()
+{
+	BlockSizes bs;
+	bs.mc = 144;
+	bs.kc = 256;
+	bs.nc = 2048;
+	return bs;
+}		//144 x 256 A block = 144KB (L2), 256 x 16 B panel = 16KB (L1), 256 x 2048 B block = 2MB (L3)
+
+inline BlockSizes checkBlockSizes(BlockSizes bs)
+{
+	if (bs.mc < GEMM_MR) bs.mc = GEMM_MR;
+	if (bs.kc < 1) bs.kc = 1;
+	if (bs.nc < GEMM_NR) bs.nc = GEMM_NR;
+	bs.mc -= bs.mc % GEMM_MR;
+	bs.nc -= bs.nc % GEMM_NR;
+	return bs;
+}		//rounds user supplied block sizes to whole micro tiles
+
+template <typename In, typename Acc>
+using PackedOf = typename KernelTraits<In, Acc>::Packed;
+
+template <int KPACK>
+inline int packedDepth(int kc)
+{
+	return (kc + KPACK - 1) / KPACK * KPACK;
+}		//kc rounded up to whole k groups, the depth a packed panel is laid out for
+
+template <typename In, typename Acc>
+inline void packPanelB(const BasicMatrix<In> &B, int pc, int kc, int jc, int nc, PackedOf<In, Acc> *packed)
+{
+	typedef KernelTraits<In, Acc> Traits;
+	const int NR = Traits::NR, KPACK = Traits::KPACK;
+	int depth = packedDepth<KPACK>(kc);
+	for (int jr = 0; jr < nc; jr += NR) {
+		int n = nc - jr < NR ? nc - jr : NR;
+		PackedOf<In, Acc> *panel = packed + (size_t)jr * depth;
+		for (int p = 0; p < depth; p++) {
+			PackedOf<In, Acc> *dst = panel + (p / KPACK) * NR * KPACK + p % KPACK;
+			int j = 0;
+			if (p < kc) {
+				const In *row = B[pc + p] + jc + jr;
+				for (; j < n; j++) dst[j * KPACK] = row[j];
+			}
+			for (; j < NR; j++) dst[j * KPACK] = 0;
+		}
+	}
+}		//copies the KC x NC block of B into contiguous KC x NR panels, zero padding the last one
+		//with KPACK > 1 the KPACK consecutive k values of each column sit next to each other
+
+template <typename In, typename Acc>
+inline void multiplyBlock(const BasicMatrix<In> &A, const PackedOf<In, Acc> *packed, BasicMatrix<Acc> &C, int ic, int mc, int pc, int kc, int jc, int nc, bool accumulate)
+{
+	typedef KernelTraits<In, Acc> Traits;
+	const int NR = Traits::NR;
+	typename Traits::Kernel kernel = MicroKernelFor<In, Acc>::kernel;
+	int depth = packedDepth<Traits::KPACK>(kc);
+	for (int jr = 0; jr < nc; jr += NR) {
+		int n = nc - jr < NR ? nc - jr : NR;
+		const PackedOf<In, Acc> *panel = packed + (size_t)jr * depth;
+		for (int ir = 0; ir < mc; ir += GEMM_MR) {
+			int m = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+			kernel(kc, A[ic + ir] + pc, A.stride, panel, C[ic + ir] + jc + jr, C.stride, m, n, accumulate);
+		}
+	}
+}		//multiplies one MC x KC block of A against an already packed KC x NC block of B, adding to C when accumulate is set
+
+template <typename P = int>
+inline P *allocatePackBuffer(const BlockSizes &bs)
+{
+	P *packed = NULL;
+	size_t bytes = (size_t)packedDepth<2>(bs.kc) * bs.nc * sizeof(P);
+	if (posix_memalign((void **)&packed, MATRIX_ALIGN, bytes) != 0) {
+		fprintf(stderr, "Couldn't allocate the B packing buffer\n");
+		exit(1);
+	}
+	return packed;
+}		//room for a KC x NC block, kc rounded up to even for the paired int16 layout
+
+template <typename P>
+struct PackBuffer {
+	P *data;
+	size_t elements;
+	PackBuffer() : data(NULL), elements(0) {}
+	~PackBuffer() { free(data); }
+};
+
+template <typename P = int>
+inline P *threadPackBuffer(const BlockSizes &bs)
+{
+	static thread_local PackBuffer<P> buffer;
+	size_t elements = (size_t)packedDepth<2>(bs.kc) * bs.nc;
+	if (buffer.elements < elements) {
+		free(buffer.data);
+		buffer.data = allocatePackBuffer<P>(bs);
+		buffer.elements = elements;
+	}
+	return buffer.data;
+}		//packing buffer owned by the calling thread, kept between multiplies so pool workers allocate it once
+
+template <typename In, typename Acc>
+inline void blockedMatrixMultiplyTile(const BasicMatrix<In> &A, const BasicMatrix<In> &B, BasicMatrix<Acc> &C, int rowStart, int rowEnd, int colStart, int colEnd, const BlockSizes &bs, PackedOf<In, Acc> *packed, bool accumulate = false)
+{
+	int K = A.cols;
+	for (int jc = colStart; jc < colEnd; jc += bs.nc) {
+		int nc = colEnd - jc < bs.nc ? colEnd - jc : bs.nc;
+		for (int pc = 0; pc < K; pc += bs.kc) {
+			int kc = K - pc < bs.kc ? K - pc : bs.kc;
+			packPanelB<In, Acc>(B, pc, kc, jc, nc, packed);
+			for (int ic = rowStart; ic < rowEnd; ic += bs.mc) {
+				int mc = rowEnd - ic < bs.mc ? rowEnd - ic : bs.mc;
+				multiplyBlock<In, Acc>(A, packed, C, ic, mc, pc, kc, jc, nc, accumulate || pc > 0);
+			}
+		}
+	}
+}		//blocked multiply of one rectangle of C using a caller owned KC x NC packing buffer, bs must already be checked
+		//C is overwritten unless accumulate is set, then the product is added to it
+
+template <typename In, typename Acc>
+inline void blockedMatrixMultiply(const BasicMatrix<In> &A, const BasicMatrix<In> &B, BasicMatrix<Acc> &C, int rowStart, int rowEnd, BlockSizes bs, bool accumulate = false)
+{
+	bs = checkBlockSizes(bs);
+	PackedOf<In, Acc> *packed = allocatePackBuffer<PackedOf<In, Acc> >(bs);
+	blockedMatrixMultiplyTile(A, B, C, rowStart, rowEnd, 0, B.cols, bs, packed, accumulate);
+	free(packed);
+}		//single threaded blocked multiply of rows rowStart..rowEnd of C, used by the sequential and MPI paths
+
+template <typename In, typename Acc>
+inline void openmpBlockedMatrixMultiply(const BasicMatrix<In> &A, const BasicMatrix<In> &B, BasicMatrix<Acc> &C, BlockSizes bs, bool accumulate = false)
+{
+	const int NR = KernelTraits<In, Acc>::NR;
+	bs = checkBlockSizes(bs);
+	int M = A.rows;
+	int K = A.cols;
+	int cols = B.cols;
+	PackedOf<In, Acc> *packed = allocatePackBuffer<PackedOf<In, Acc> >(bs);
+
+	#pragma omp parallel
+	{
+		for (int jc = 0; jc < cols; jc += bs.nc) {
+			int nc = cols - jc < bs.nc ? cols - jc : bs.nc;
+			for (int pc = 0; pc < K; pc += bs.kc) {
+				int kc = K - pc < bs.kc ? K - pc : bs.kc;
+				int depth = packedDepth<KernelTraits<In, Acc>::KPACK>(kc);
+
+				#pragma omp for schedule(static)
+				for (int jr = 0; jr < nc; jr += NR) {
+					int n = nc - jr < NR ? nc - jr : NR;
+					packPanelB<In, Acc>(B, pc, kc, jc + jr, n, packed + (size_t)jr * depth);
+				}		//threads pack the shared B block one panel each, implicit barrier before use
+
+				#pragma omp for schedule(static)
+				for (int ic = 0; ic < M; ic += bs.mc) {
+					int mc = M - ic < bs.mc ? M - ic : bs.mc;
+					multiplyBlock<In, Acc>(A, packed, C, ic, mc, pc, kc, jc, nc, accumulate || pc > 0);
+				}		//static, so every thread keeps the same row blocks that firstTouch (affinity.h) placed on its node
+					//implicit barrier keeps the packed block alive until every thread is done with it
+			}
+		}
+	}
+	free(packed);
+}		//blocked multiply with the B block packed cooperatively and the MC row blocks shared out between OpenMP threads
+
+#endif
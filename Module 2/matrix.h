@@ -0,0 +1,133 @@
+/* matrix.h
+ *
+ * Runtime sized matrix shared by the Module 2 and Module 3 matrix multiplication programs.
+ * Storage is heap allocated, 64 byte aligned and row major; every row starts on a 64 byte
+ * boundary because the stride is rounded up to a whole cache line of elements.
+ * Matrix is the int version, BasicMatrix<T> holds the other element types (int8_t ... double).
+ *
+ * Header only, include it from the program that needs it:
+ *	#include "matrix.h"			(Module 2)
+ *	#include "../../Module 2/matrix.h"	(Module 3)
+ */
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MATRIX_ALIGN 64			//bytes, one cache line
+
+template <typename T>
+struct BasicMatrix {
+	int rows;
+	int cols;
+	int stride;			//elements between the start of consecutive rows, >= cols
+	T *data;
+
+	T *operator[](int i) { return data + (size_t)i * stride; }
+	const T *operator[](int i) const { return data + (size_t)i * stride; }
+	size_t size() const { return (size_t)rows * stride; }		//elements allocated, including row padding
+};
+
+typedef BasicMatrix<int> Matrix;		//the element type used by the programs unless they ask for another
+
+template <typename T> inline const char *elementTypeName();
+template <> inline const char *elementTypeName<int8_t>() { return "int8"; }
+template <> inline const char *elementTypeName<int16_t>() { return "int16"; }
+template <> inline const char *elementTypeName<int>() { return "int32"; }
+template <> inline const char *elementTypeName<float>() { return "float"; }
+template <> inline const char *elementTypeName<double>() { return "double"; }
+
+template <typename T = int>
+inline int matrixStride(int cols)
+{
+	const int perLine = MATRIX_ALIGN / (int)sizeof(T);
+	return (cols + perLine - 1) / perLine * perLine;
+}		//rounds the row length up to a whole number of cache lines
+
+template <typename T>
+inline BasicMatrix<T> createMatrixOf(int rows, int cols)
+{
+	BasicMatrix<T> m;
+	m.rows = rows;
+	m.cols = cols;
+	m.stride = matrixStride<T>(cols);
+	m.data = NULL;
+
+	size_t bytes = m.size() * sizeof(T);
+	if (bytes == 0) bytes = MATRIX_ALIGN;
+	if (posix_memalign((void **)&m.data, MATRIX_ALIGN, bytes) != 0) {
+		fprintf(stderr, "Couldn't allocate a %d x %d matrix\n", rows, cols);
+		exit(1);
+	}
+	return m;
+}		//allocates an uninitialised matrix, pages are first touched by whoever initialises it
+
+inline Matrix createMatrix(int rows, int cols)
+{
+	return createMatrixOf<int>(rows, cols);
+}
+
+template <typename T>
+inline void freeMatrix(BasicMatrix<T> &m)
+{
+	free(m.data);
+	m.data = NULL;
+	m.rows = m.cols = m.stride = 0;
+}
+
+template <typename T>
+inline void zeroMatrix(BasicMatrix<T> &m)
+{
+	memset(m.data, 0, m.size() * sizeof(T));
+}
+
+template <typename T>
+inline BasicMatrix<T> rowView(const BasicMatrix<T> &m, int start, int end)
+{
+	BasicMatrix<T> view = m;
+	view.rows = end - start;
+	view.data = m.data + (size_t)start * m.stride;
+	return view;
+}		//non owning view of rows start..end, never pass it to freeMatrix
+
+template <typename T>
+inline BasicMatrix<T> subMatrix(const BasicMatrix<T> &m, int row, int col, int rows, int cols)
+{
+	BasicMatrix<T> view = m;
+	view.rows = rows;
+	view.cols = cols;
+	view.data = m.data + (size_t)row * m.stride + col;
+	return view;
+}		//non owning view of a rectangle, never pass it to freeMatrix
+
+inline void partitionRows(int n, int parts, int part, int &start, int &end)
+{
+	int base = n / parts;
+	int extra = n % parts;
+	start = part * base + (part < extra ? part : extra);
+	end = start + base + (part < extra ? 1 : 0);
+}		//splits n rows into parts balanced ranges, the first n % parts ranges get one extra row
+
+inline int parseSize(int argc, char *argv[], int index, int fallback)
+{
+	if (argc > index) {
+		int value = atoi(argv[index]);
+		if (value > 0) return value;
+	}
+	return fallback;
+}		//reads a positive integer from argv, or returns fallback
+
+inline int parseOption(int argc, char *argv[], const char *name, int fallback)
+{
+	size_t length = strlen(name);
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') return atoi(argv[i] + length + 1);
+	}
+	return fallback;
+}		//reads a --name=value option from anywhere in argv, or returns fallback
+
+#endif
@@ -0,0 +1,456 @@
+/* microKernel.h
+ *
+ * Register blocked MR x NR micro kernels used by gemm.h, C[m x n] (+)= A[m x kc] * packed B panel.
+ * Every kernel has a scalar version plus AVX2 and AVX-512 versions built with per function target
+ * attributes, so one binary carries all of them and picks the widest one the CPU supports (cpuid)
+ * the first time a type is used.
+ *
+ * KernelTraits<In, Acc> selects the kernels for an input / accumulator pair at compile time:
+ *
+ *	int8_t, int16_t -> int	B packed as int16 pairs, madd_epi16 (or AVX-512 VNNI dpwssd) multiplies
+ *				two k values per instruction into int32, 6 x 16 tile
+ *	int -> int		mullo_epi32 + add, 6 x 16 tile
+ *	float -> float		FMA, 6 x 16 tile
+ *	double -> double	FMA, 6 x 8 tile
+ *
+ * Any other pair has no KernelTraits and fails to compile. int16 inputs of -32768 in both halves of a
+ * pair overflow the int32 pair sum, which the scalar kernel does not; int8 inputs cannot overflow.
+ */
+
+#ifndef MICRO_KERNEL_H
+#define MICRO_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MICRO_KERNEL_X86 1
+#endif
+
+#define GEMM_MR 6			//rows of C per micro kernel call, for every type
+#define GEMM_NR 16			//widest tile, block sizes are rounded to it so every type's NR divides them
+
+template <typename Acc, int MR, int NR>
+inline void storeTile(const Acc tile[MR][NR], Acc *c, int ldc, int m, int n, bool accumulate)
+{
+	for (int r = 0; r < m; r++) {
+		Acc *cr = c + (size_t)r * ldc;
+		for (int j = 0; j < n; j++) cr[j] = accumulate ? cr[j] + tile[r][j] : tile[r][j];
+	}
+}		//writes back the valid m x n corner of a register tile
+
+template <typename In, typename Packed, typename Acc, int MR, int NR, int KPACK>
+inline void microKernelScalar(int kc, const In *a, int lda, const Packed *b, Acc *c, int ldc, int m, int n, bool accumulate)
+{
+	Acc acc[MR][NR] = {};
+	const In *rows[MR];
+	for (int r = 0; r < MR; r++) rows[r] = a + (size_t)(r < m ? r : 0) * lda;		//short tiles recompute row 0, never stored
+
+	for (int p = 0; p < kc; p++) {
+		const Packed *bp = b + (p / KPACK) * NR * KPACK + p % KPACK;
+		for (int r = 0; r < MR; r++) {
+			Acc ar = (Acc)rows[r][p];
+			for (int j = 0; j < NR; j++) acc[r][j] += ar * (Acc)bp[j * KPACK];
+		}
+	}
+	storeTile<Acc, MR, NR>(acc, c, ldc, m, n, accumulate);
+}		//portable fallback for every type, the compiler may still vectorise the NR loop for the build target
+
+#ifdef MICRO_KERNEL_X86
+
+/* int -> int */
+
+__attribute__((target("avx2")))
+inline void microKernelAvx2(int kc, const int *a, int lda, const int *b, int *c, int ldc, int m, int n, bool accumulate)
+{
+	__m256i acc[GEMM_MR][2];
+	const int *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r][0] = _mm256_setzero_si256();
+		acc[r][1] = _mm256_setzero_si256();
+	}
+
+	for (int p = 0; p < kc; p++) {
+		__m256i b0 = _mm256_load_si256((const __m256i *)(b + p * 16));
+		__m256i b1 = _mm256_load_si256((const __m256i *)(b + p * 16 + 8));
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			__m256i ar = _mm256_set1_epi32(rows[r][p]);
+			acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_mullo_epi32(ar, b0));
+			acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_mullo_epi32(ar, b1));
+		}
+	}
+
+	if (m == GEMM_MR && n == 16) {
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			__m256i *cr = (__m256i *)(c + (size_t)r * ldc);
+			if (accumulate) {
+				acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_loadu_si256(cr));
+				acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_loadu_si256(cr + 1));
+			}
+			_mm256_storeu_si256(cr, acc[r][0]);
+			_mm256_storeu_si256(cr + 1, acc[r][1]);
+		}
+	} else {
+		alignas(64) int tile[GEMM_MR][16];
+		for (int r = 0; r < GEMM_MR; r++) {
+			_mm256_store_si256((__m256i *)tile[r], acc[r][0]);
+			_mm256_store_si256((__m256i *)(tile[r] + 8), acc[r][1]);
+		}
+		storeTile<int, GEMM_MR, 16>(tile, c, ldc, m, n, accumulate);
+	}
+}
+
+__attribute__((target("avx512f")))
+inline void microKernelAvx512(int kc, const int *a, int lda, const int *b, int *c, int ldc, int m, int n, bool accumulate)
+{
+	__m512i acc[GEMM_MR];
+	const int *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r] = _mm512_setzero_si512();
+	}
+
+	for (int p = 0; p < kc; p++) {
+		__m512i bp = _mm512_load_si512((const void *)(b + p * 16));
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			acc[r] = _mm512_add_epi32(acc[r], _mm512_mullo_epi32(_mm512_set1_epi32(rows[r][p]), bp));
+		}
+	}
+
+	__mmask16 mask = (__mmask16)(n == 16 ? 0xFFFF : (1u << n) - 1);
+	for (int r = 0; r < m; r++) {
+		int *cr = c + (size_t)r * ldc;
+		if (accumulate) acc[r] = _mm512_add_epi32(acc[r], _mm512_maskz_loadu_epi32(mask, cr));
+		_mm512_mask_storeu_epi32(cr, mask, acc[r]);
+	}		//masked loads and stores handle the short edge tiles without a bounce buffer
+}
+
+/* int8_t, int16_t -> int, B packed as 16 columns x 2 k values of int16 */
+
+template <typename In>
+inline int pairOf(const In *row, int p, bool single)
+{
+	uint32_t lo = (uint16_t)(int16_t)row[p];
+	uint32_t hi = single ? 0 : (uint16_t)(int16_t)row[p + 1];
+	return (int)(lo | hi << 16);
+}		//two consecutive k values of A as the int16 pair madd_epi16 expects, the odd last k pairs with 0
+
+template <typename In>
+__attribute__((target("avx2")))
+inline void microKernelPairsAvx2(int kc, const In *a, int lda, const int16_t *b, int *c, int ldc, int m, int n, bool accumulate)
+{
+	__m256i acc[GEMM_MR][2];
+	const In *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r][0] = _mm256_setzero_si256();
+		acc[r][1] = _mm256_setzero_si256();
+	}
+
+	for (int p = 0; p < kc; p += 2) {
+		bool single = p + 1 == kc;
+		__m256i b0 = _mm256_load_si256((const __m256i *)(b + p * 16));
+		__m256i b1 = _mm256_load_si256((const __m256i *)(b + p * 16 + 16));
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			__m256i ar = _mm256_set1_epi32(pairOf(rows[r], p, single));
+			acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(ar, b0));
+			acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(ar, b1));
+		}
+	}
+
+	alignas(64) int tile[GEMM_MR][16];
+	for (int r = 0; r < GEMM_MR; r++) {
+		_mm256_store_si256((__m256i *)tile[r], acc[r][0]);
+		_mm256_store_si256((__m256i *)(tile[r] + 8), acc[r][1]);
+	}
+	storeTile<int, GEMM_MR, 16>(tile, c, ldc, m, n, accumulate);
+}
+
+template <typename In>
+__attribute__((target("avx512f,avx512bw")))
+inline void microKernelPairsAvx512(int kc, const In *a, int lda, const int16_t *b, int *c, int ldc, int m, int n, bool accumulate)
+{
+	__m512i acc[GEMM_MR];
+	const In *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r] = _mm512_setzero_si512();
+	}
+
+	for (int p = 0; p < kc; p += 2) {
+		bool single = p + 1 == kc;
+		__m512i bp = _mm512_load_si512((const void *)(b + p * 16));
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			acc[r] = _mm512_add_epi32(acc[r], _mm512_madd_epi16(_mm512_set1_epi32(pairOf(rows[r], p, single)), bp));
+		}
+	}
+
+	__mmask16 mask = (__mmask16)(n == 16 ? 0xFFFF : (1u << n) - 1);
+	for (int r = 0; r < m; r++) {
+		int *cr = c + (size_t)r * ldc;
+		if (accumulate) acc[r] = _mm512_add_epi32(acc[r], _mm512_maskz_loadu_epi32(mask, cr));
+		_mm512_mask_storeu_epi32(cr, mask, acc[r]);
+	}
+}
+
+template <typename In>
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+inline void microKernelPairsVnni(int kc, const In *a, int lda, const int16_t *b, int *c, int ldc, int m, int n, bool accumulate)
+{
+	__m512i acc[GEMM_MR];
+	const In *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r] = _mm512_setzero_si512();
+	}
+
+	for (int p = 0; p < kc; p += 2) {
+		bool single = p + 1 == kc;
+		__m512i bp = _mm512_load_si512((const void *)(b + p * 16));
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			acc[r] = _mm512_dpwssd_epi32(acc[r], _mm512_set1_epi32(pairOf(rows[r], p, single)), bp);
+		}
+	}		//dpwssd fuses the pair multiply and the int32 add
+
+	__mmask16 mask = (__mmask16)(n == 16 ? 0xFFFF : (1u << n) - 1);
+	for (int r = 0; r < m; r++) {
+		int *cr = c + (size_t)r * ldc;
+		if (accumulate) acc[r] = _mm512_add_epi32(acc[r], _mm512_maskz_loadu_epi32(mask, cr));
+		_mm512_mask_storeu_epi32(cr, mask, acc[r]);
+	}
+}
+
+/* float -> float */
+
+__attribute__((target("avx2,fma")))
+inline void microKernelFloatAvx2(int kc, const float *a, int lda, const float *b, float *c, int ldc, int m, int n, bool accumulate)
+{
+	__m256 acc[GEMM_MR][2];
+	const float *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r][0] = _mm256_setzero_ps();
+		acc[r][1] = _mm256_setzero_ps();
+	}
+
+	for (int p = 0; p < kc; p++) {
+		__m256 b0 = _mm256_load_ps(b + p * 16);
+		__m256 b1 = _mm256_load_ps(b + p * 16 + 8);
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			__m256 ar = _mm256_broadcast_ss(rows[r] + p);
+			acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+			acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+		}
+	}
+
+	alignas(64) float tile[GEMM_MR][16];
+	for (int r = 0; r < GEMM_MR; r++) {
+		_mm256_store_ps(tile[r], acc[r][0]);
+		_mm256_store_ps(tile[r] + 8, acc[r][1]);
+	}
+	storeTile<float, GEMM_MR, 16>(tile, c, ldc, m, n, accumulate);
+}
+
+__attribute__((target("avx512f")))
+inline void microKernelFloatAvx512(int kc, const float *a, int lda, const float *b, float *c, int ldc, int m, int n, bool accumulate)
+{
+	__m512 acc[GEMM_MR];
+	const float *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r] = _mm512_setzero_ps();
+	}
+
+	for (int p = 0; p < kc; p++) {
+		__m512 bp = _mm512_load_ps(b + p * 16);
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) acc[r] = _mm512_fmadd_ps(_mm512_set1_ps(rows[r][p]), bp, acc[r]);
+	}
+
+	__mmask16 mask = (__mmask16)(n == 16 ? 0xFFFF : (1u << n) - 1);
+	for (int r = 0; r < m; r++) {
+		float *cr = c + (size_t)r * ldc;
+		if (accumulate) acc[r] = _mm512_add_ps(acc[r], _mm512_maskz_loadu_ps(mask, cr));
+		_mm512_mask_storeu_ps(cr, mask, acc[r]);
+	}
+}
+
+/* double -> double, 8 columns */
+
+__attribute__((target("avx2,fma")))
+inline void microKernelDoubleAvx2(int kc, const double *a, int lda, const double *b, double *c, int ldc, int m, int n, bool accumulate)
+{
+	__m256d acc[GEMM_MR][2];
+	const double *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r][0] = _mm256_setzero_pd();
+		acc[r][1] = _mm256_setzero_pd();
+	}
+
+	for (int p = 0; p < kc; p++) {
+		__m256d b0 = _mm256_load_pd(b + p * 8);
+		__m256d b1 = _mm256_load_pd(b + p * 8 + 4);
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) {
+			__m256d ar = _mm256_broadcast_sd(rows[r] + p);
+			acc[r][0] = _mm256_fmadd_pd(ar, b0, acc[r][0]);
+			acc[r][1] = _mm256_fmadd_pd(ar, b1, acc[r][1]);
+		}
+	}
+
+	alignas(64) double tile[GEMM_MR][8];
+	for (int r = 0; r < GEMM_MR; r++) {
+		_mm256_store_pd(tile[r], acc[r][0]);
+		_mm256_store_pd(tile[r] + 4, acc[r][1]);
+	}
+	storeTile<double, GEMM_MR, 8>(tile, c, ldc, m, n, accumulate);
+}
+
+__attribute__((target("avx512f")))
+inline void microKernelDoubleAvx512(int kc, const double *a, int lda, const double *b, double *c, int ldc, int m, int n, bool accumulate)
+{
+	__m512d acc[GEMM_MR];
+	const double *rows[GEMM_MR];
+	#pragma GCC unroll 6
+	for (int r = 0; r < GEMM_MR; r++) {
+		rows[r] = a + (size_t)(r < m ? r : 0) * lda;
+		acc[r] = _mm512_setzero_pd();
+	}
+
+	for (int p = 0; p < kc; p++) {
+		__m512d bp = _mm512_load_pd(b + p * 8);
+		#pragma GCC unroll 6
+		for (int r = 0; r < GEMM_MR; r++) acc[r] = _mm512_fmadd_pd(_mm512_set1_pd(rows[r][p]), bp, acc[r]);
+	}
+
+	__mmask8 mask = (__mmask8)(n == 8 ? 0xFF : (1u << n) - 1);
+	for (int r = 0; r < m; r++) {
+		double *cr = c + (size_t)r * ldc;
+		if (accumulate) acc[r] = _mm512_add_pd(acc[r], _mm512_maskz_loadu_pd(mask, cr));
+		_mm512_mask_storeu_pd(cr, mask, acc[r]);
+	}
+}
+
+#endif
+
+inline bool cpuHas(const char *feature)
+{
+#ifdef MICRO_KERNEL_X86
+	__builtin_cpu_init();
+	if (strcmp(feature, "avx512vnni") == 0) return __builtin_cpu_supports("avx512vnni");
+	if (strcmp(feature, "avx512bw") == 0) return __builtin_cpu_supports("avx512bw");
+	if (strcmp(feature, "avx512f") == 0) return __builtin_cpu_supports("avx512f");
+	if (strcmp(feature, "avx2") == 0) return __builtin_cpu_supports("avx2");
+	if (strcmp(feature, "fma") == 0) return __builtin_cpu_supports("fma");
+#endif
+	(void)feature;
+	return false;
+}		//cpuid feature test, always false off x86
+
+template <typename In, typename Acc>
+struct KernelTraits;			//only the pairs specialised below have kernels
+
+template <>
+struct KernelTraits<int, int> {
+	typedef int Packed;
+	enum { MR = GEMM_MR, NR = 16, KPACK = 1 };
+	typedef void (*Kernel)(int, const int *, int, const Packed *, int *, int, int, int, bool);
+	static Kernel select(const char **name)
+	{
+#ifdef MICRO_KERNEL_X86
+		if (cpuHas("avx512f")) { *name = "avx512"; return microKernelAvx512; }
+		if (cpuHas("avx2")) { *name = "avx2"; return microKernelAvx2; }
+#endif
+		*name = "scalar";
+		return microKernelScalar<int, Packed, int, MR, NR, KPACK>;
+	}
+};
+
+template <typename In>
+struct PairKernelTraits {
+	typedef int16_t Packed;
+	enum { MR = GEMM_MR, NR = 16, KPACK = 2 };
+	typedef void (*Kernel)(int, const In *, int, const Packed *, int *, int, int, int, bool);
+	static Kernel select(const char **name)
+	{
+#ifdef MICRO_KERNEL_X86
+		if (cpuHas("avx512vnni") && cpuHas("avx512bw")) { *name = "avx512vnni"; return microKernelPairsVnni<In>; }
+		if (cpuHas("avx512bw")) { *name = "avx512"; return microKernelPairsAvx512<In>; }
+		if (cpuHas("avx2")) { *name = "avx2"; return microKernelPairsAvx2<In>; }
+#endif
+		*name = "scalar";
+		return microKernelScalar<In, Packed, int, MR, NR, KPACK>;
+	}
+};		//narrow integers are widened to int16 pairs when B is packed and accumulate into int32
+
+template <> struct KernelTraits<int16_t, int> : PairKernelTraits<int16_t> {};
+template <> struct KernelTraits<int8_t, int> : PairKernelTraits<int8_t> {};
+
+template <>
+struct KernelTraits<float, float> {
+	typedef float Packed;
+	enum { MR = GEMM_MR, NR = 16, KPACK = 1 };
+	typedef void (*Kernel)(int, const float *, int, const Packed *, float *, int, int, int, bool);
+	static Kernel select(const char **name)
+	{
+#ifdef MICRO_KERNEL_X86
+		if (cpuHas("avx512f")) { *name = "avx512"; return microKernelFloatAvx512; }
+		if (cpuHas("avx2") && cpuHas("fma")) { *name = "avx2"; return microKernelFloatAvx2; }
+#endif
+		*name = "scalar";
+		return microKernelScalar<float, Packed, float, MR, NR, KPACK>;
+	}
+};
+
+template <>
+struct KernelTraits<double, double> {
+	typedef double Packed;
+	enum { MR = GEMM_MR, NR = 8, KPACK = 1 };
+	typedef void (*Kernel)(int, const double *, int, const Packed *, double *, int, int, int, bool);
+	static Kernel select(const char **name)
+	{
+#ifdef MICRO_KERNEL_X86
+		if (cpuHas("avx512f")) { *name = "avx512"; return microKernelDoubleAvx512; }
+		if (cpuHas("avx2") && cpuHas("fma")) { *name = "avx2"; return microKernelDoubleAvx2; }
+#endif
+		*name = "scalar";
+		return microKernelScalar<double, Packed, double, MR, NR, KPACK>;
+	}
+};
+
+template <typename In, typename Acc>
+struct MicroKernelFor {
+	static const char *name;
+	static typename KernelTraits<In, Acc>::Kernel kernel;
+};
+
+template <typename In, typename Acc>
+const char *MicroKernelFor<In, Acc>::name = "scalar";
+
+template <typename In, typename Acc>
+typename KernelTraits<In, Acc>::Kernel MicroKernelFor<In, Acc>::kernel = KernelTraits<In, Acc>::select(&MicroKernelFor<In, Acc>::name);
+		//chosen once per type pair, during static initialisation
+
+inline const char *&microKernelName = MicroKernelFor<int, int>::name;		//the int kernel, reported by the programs
+inline KernelTraits<int, int>::Kernel &microKernel = MicroKernelFor<int, int>::kernel;
+
+#endif
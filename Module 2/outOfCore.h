@@ -0,0 +1,236 @@
+/* outOfCore.h
+ *
+ * Matrix multiply for matrices that live in files instead of memory, C = A * B.
+ * A matrix file is a 4096 byte header followed by the rows, padded to the same stride as
+ * createMatrix, so a file mapped with mmap is an ordinary Matrix and any of the kernels can read it.
+ * Nothing has to fit in RAM: the page cache holds whatever the access pattern is using.
+ *
+ * The multiply walks C in tile x tile blocks and, for each block, the tiles of A's row panel and
+ * B's column panel along k. A prefetch thread copies the next A and B tiles out of the mappings into
+ * one of two buffer pairs while the multiply runs on the other pair, so the page faults and disk reads
+ * happen on the prefetch thread and the kernel only ever sees resident, contiguous tiles. Each finished
+ * C block is copied back into its mapping and the kernel writes the dirty pages out in the background.
+ *
+ * With t = tile the working set is five t x t tiles (2 x A, 2 x B, C) and the files are read
+ * 2 N^3 / t elements in all, so a tile of a few thousand keeps the I/O a small fraction of the
+ * 2 N^3 operations. waitSeconds in the result is the time the multiply sat waiting for the prefetch
+ * thread, close to zero when the I/O is hidden.
+ */
+
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "matrix.h"
+#include "benchmark.h"
+
+#define MATRIX_FILE_MAGIC "SITMAT1"
+#define MATRIX_FILE_HEADER 4096			//bytes before the first row, one page so the rows start page aligned
+#define OUT_OF_CORE_TILE 2048			//default tile edge, five tiles of ints is 80 MB
+
+typedef void (*TileMultiply)(const Matrix &A, const Matrix &B, Matrix &C, bool accumulate);		//C = A * B, or C += A * B
+
+struct MatrixFile {
+	int fd;
+	void *map;
+	size_t mapBytes;
+	Matrix m;			//the rows in the file, through the mapping
+};
+
+struct MatrixFileHeader {
+	char magic[8];
+	int rows;
+	int cols;
+	int stride;
+};
+
+struct OutOfCoreStats {
+	double waitSeconds;		//multiply thread waiting for a tile
+	double bytesRead;		//copied out of the A and B mappings
+	double bytesWritten;		//copied into the C mapping
+};
+
+inline MatrixFile mapMatrixFile(int fd, int rows, int cols, int stride, bool writable, const char *path)
+{
+	MatrixFile f;
+	f.fd = fd;
+	f.mapBytes = MATRIX_FILE_HEADER + (size_t)rows * stride * sizeof(int);
+	f.map = mmap(NULL, f.mapBytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (f.map == MAP_FAILED) {
+		perror(path);
+		exit(1);
+	}
+	f.m.rows = rows;
+	f.m.cols = cols;
+	f.m.stride = stride;
+	f.m.data = (int *)((char *)f.map + MATRIX_FILE_HEADER);
+	return f;
+}
+
+inline MatrixFile createMatrixFile(const char *path, int rows, int cols)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	MatrixFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(MATRIX_FILE_MAGIC));
+	header.rows = rows;
+	header.cols = cols;
+	header.stride = matrixStride<int>(cols);
+	if (ftruncate(fd, MATRIX_FILE_HEADER + (off_t)rows * header.stride * sizeof(int)) != 0 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+		perror(path);
+		exit(1);
+	}		//a sparse file, blocks are only allocated as rows are written
+	return mapMatrixFile(fd, rows, cols, header.stride, true, path);
+}		//new rows x cols matrix file, contents zero, mapped read write
+
+inline MatrixFile openMatrixFile(const char *path, bool writable)
+{
+	int fd = open(path, writable ? O_RDWR : O_RDONLY);
+	MatrixFileHeader header;
+	if (fd < 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(MATRIX_FILE_MAGIC)) != 0) {
+		fprintf(stderr, "%s is not a matrix file\n", path);
+		exit(1);
+	}
+	return mapMatrixFile(fd, header.rows, header.cols, header.stride, writable, path);
+}
+
+inline void closeMatrixFile(MatrixFile &f)
+{
+	munmap(f.map, f.mapBytes);
+	close(f.fd);
+	f.m.data = NULL;
+}
+
+struct TileStep {
+	int i, j, k;			//tile row of C, tile column of C, tile along the inner dimension
+};
+
+struct Prefetcher {
+	const Matrix *A;
+	const Matrix *B;
+	int tile;
+	std::vector<TileStep> steps;
+	Matrix bufA[2];
+	Matrix bufB[2];
+	int filled[2];			//step held by each buffer pair, -1 when free
+	double bytesRead;
+
+	pthread_t thread;
+	pthread_mutex_t mutx;
+	pthread_cond_t changed;		//a buffer pair was filled or freed
+};
+
+inline int tileEnd(int start, int tile, int n)
+{
+	return start + tile < n ? start + tile : n;
+}
+
+inline void copyTile(const Matrix &from, int row, int col, int rows, int cols, Matrix &to)
+{
+	to.rows = rows;
+	to.cols = cols;
+	for (int r = 0; r < rows; r++) memcpy(to[r], from[row + r] + col, cols * sizeof(int));
+}		//faults the file pages in on the calling thread
+
+inline void *prefetchTiles(void *arg)
+{
+	Prefetcher *p = (Prefetcher *)arg;
+	for (size_t s = 0; s < p->steps.size(); s++) {
+		int slot = s % 2;
+		pthread_mutex_lock(&p->mutx);
+		while (p->filled[slot] != -1) pthread_cond_wait(&p->changed, &p->mutx);
+		pthread_mutex_unlock(&p->mutx);
+
+		const TileStep &step = p->steps[s];
+		int i0 = step.i * p->tile, j0 = step.j * p->tile, k0 = step.k * p->tile;
+		int rows = tileEnd(i0, p->tile, p->A->rows) - i0, cols = tileEnd(j0, p->tile, p->B->cols) - j0, depth = tileEnd(k0, p->tile, p->A->cols) - k0;
+		copyTile(*p->A, i0, k0, rows, depth, p->bufA[slot]);
+		copyTile(*p->B, k0, j0, depth, cols, p->bufB[slot]);
+
+		pthread_mutex_lock(&p->mutx);
+		p->bytesRead += ((double)rows + cols) * depth * sizeof(int);
+		p->filled[slot] = (int)s;
+		pthread_cond_broadcast(&p->changed);
+		pthread_mutex_unlock(&p->mutx);
+	}
+	return NULL;
+}		//fills the buffer pairs in step order, one step ahead of the multiply
+
+inline OutOfCoreStats outOfCoreMultiply(const Matrix &A, const Matrix &B, Matrix &C, int tile, TileMultiply multiply)
+{
+	if (tile < 1) tile = OUT_OF_CORE_TILE;
+	int tilesI = (A.rows + tile - 1) / tile, tilesJ = (B.cols + tile - 1) / tile, tilesK = (A.cols + tile - 1) / tile;
+
+	Prefetcher p;
+	p.A = &A;
+	p.B = &B;
+	p.tile = tile;
+	for (int i = 0; i < tilesI; i++) {
+		for (int j = 0; j < tilesJ; j++) {
+			for (int k = 0; k < tilesK; k++) p.steps.push_back(TileStep{ i, j, k });
+		}
+	}		//k innermost, so each C block is finished before the next one starts
+	for (int s = 0; s < 2; s++) {
+		p.bufA[s] = createMatrix(tile, tile);
+		p.bufB[s] = createMatrix(tile, tile);
+		p.filled[s] = -1;
+	}
+	p.bytesRead = 0;
+	pthread_mutex_init(&p.mutx, NULL);
+	pthread_cond_init(&p.changed, NULL);
+
+	OutOfCoreStats stats;
+	memset(&stats, 0, sizeof(stats));
+	Matrix blockC = createMatrix(tile, tile);
+	if (!p.steps.empty()) pthread_create(&p.thread, NULL, prefetchTiles, &p);
+
+	for (size_t s = 0; s < p.steps.size(); s++) {
+		int slot = s % 2;
+		double start = wallTime();
+		pthread_mutex_lock(&p.mutx);
+		while (p.filled[slot] != (int)s) pthread_cond_wait(&p.changed, &p.mutx);
+		pthread_mutex_unlock(&p.mutx);
+		stats.waitSeconds += wallTime() - start;
+
+		const TileStep &step = p.steps[s];
+		Matrix tileC = subMatrix(blockC, 0, 0, p.bufA[slot].rows, p.bufB[slot].cols);
+		multiply(p.bufA[slot], p.bufB[slot], tileC, step.k > 0);		//first k tile overwrites the block, the rest add to it
+
+		pthread_mutex_lock(&p.mutx);
+		p.filled[slot] = -1;
+		pthread_cond_broadcast(&p.changed);
+		pthread_mutex_unlock(&p.mutx);
+
+		if (step.k == tilesK - 1) {
+			Matrix out = subMatrix(C, step.i * tile, step.j * tile, tileC.rows, tileC.cols);
+			for (int r = 0; r < tileC.rows; r++) memcpy(out[r], tileC[r], tileC.cols * sizeof(int));
+			stats.bytesWritten += (double)tileC.rows * tileC.cols * sizeof(int);
+		}		//the page cache writes the block back to the file in the background
+	}
+	if (tilesK == 0) zeroMatrix(C);
+
+	if (!p.steps.empty()) pthread_join(p.thread, NULL);
+	stats.bytesRead = p.bytesRead;
+	pthread_mutex_destroy(&p.mutx);
+	pthread_cond_destroy(&p.changed);
+	for (int s = 0; s < 2; s++) {
+		freeMatrix(p.bufA[s]);
+		freeMatrix(p.bufB[s]);
+	}
+	freeMatrix(blockC);
+	return stats;
+}		//A, B and C are usually mapped files but any matrices work, multiply runs on resident tiles
+
+#endif
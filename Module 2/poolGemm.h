@@ -0,0 +1,68 @@
+/* poolGemm.h
+ *
+ * Blocked matrix multiplication on the persistent pthread pool from threadPool.h.
+ * C is cut into tiles of whole micro tiles, the tiles are numbered row by row so each worker's
+ * starting range shares rows of A, and idle workers steal the remaining tiles of busy ones.
+ */
+
+#ifndef POOL_GEMM_H
+#define POOL_GEMM_H
+
+#include "gemm.h"
+#include "threadPool.h"
+
+#define POOL_TILE_COLS 256		//widest tile, in columns of C
+#define POOL_TILES_PER_THREAD 4		//tiles are shrunk until every worker starts with at least this many
+
+template <typename In, typename Acc>
+struct TiledMultiply {
+	const BasicMatrix<In> *A;
+	const BasicMatrix<In> *B;
+	BasicMatrix<Acc> *C;
+	BlockSizes bs;
+	int tileRows;
+	int tileCols;
+	int tilesAcross;		//tiles per row of C
+};
+
+template <typename In, typename Acc>
+inline void multiplyTile(int tile, int /*worker*/, void *arg)
+{
+	TiledMultiply<In, Acc> *job = (TiledMultiply<In, Acc> *)arg;
+	int rowStart = (tile / job->tilesAcross) * job->tileRows;
+	int colStart = (tile % job->tilesAcross) * job->tileCols;
+	int rowEnd = rowStart + job->tileRows < job->C->rows ? rowStart + job->tileRows : job->C->rows;
+	int colEnd = colStart + job->tileCols < job->C->cols ? colStart + job->tileCols : job->C->cols;
+
+	blockedMatrixMultiplyTile(*job->A, *job->B, *job->C, rowStart, rowEnd, colStart, colEnd, job->bs, threadPackBuffer<PackedOf<In, Acc> >(job->bs));
+}		//tiles never overlap, so workers write C without locking
+
+inline void chooseTileSize(int rows, int cols, int numThreads, const BlockSizes &bs, int &tileRows, int &tileCols)
+{
+	tileRows = bs.mc;
+	tileCols = bs.nc < POOL_TILE_COLS ? bs.nc : POOL_TILE_COLS;
+	while (true) {
+		long tiles = (long)((rows + tileRows - 1) / tileRows) * ((cols + tileCols - 1) / tileCols);
+		if (tiles >= (long)numThreads * POOL_TILES_PER_THREAD) break;
+		if (tileRows >= tileCols / 4 && tileRows > 2 * GEMM_MR) tileRows = (tileRows / 2 + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+		else if (tileCols > 4 * GEMM_NR) tileCols = (tileCols / 2 + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+		else break;
+	}
+}		//starts from one L2 block of rows, halves the tile until there is enough work to steal
+
+template <typename In, typename Acc>
+inline void poolMatrixMultiply(ThreadPool *pool, const BasicMatrix<In> &A, const BasicMatrix<In> &B, BasicMatrix<Acc> &C, BlockSizes bs)
+{
+	TiledMultiply<In, Acc> job;
+	job.A = &A;
+	job.B = &B;
+	job.C = &C;
+	job.bs = checkBlockSizes(bs);
+	chooseTileSize(C.rows, C.cols, pool->numThreads, job.bs, job.tileRows, job.tileCols);
+	job.tilesAcross = (C.cols + job.tileCols - 1) / job.tileCols;
+
+	int tilesDown = (C.rows + job.tileRows - 1) / job.tileRows;
+	runTiles(pool, tilesDown * job.tilesAcross, multiplyTile<In, Acc>, &job);
+}		//C = A * B on the pool's workers, returns once every tile is written
+
+#endif
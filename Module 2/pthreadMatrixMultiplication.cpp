@@ -1,19 +1,22 @@
 // pthreadMatrixMultiplication.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
+// usage: pthreadMatrixMultiplication [n]	(n x n matrices, 100 by default)
 
-#include "pch.h"
+//#include "pch.h"
 #include <iostream>
 #include <random>
 #include <time.h>
 #include <pthread.h>
+#include "matrix.h"
 
 #define NUM_THREADS 5
 
 using namespace std;
 
-const int n = 100;
+#define DEFAULT_N 100
+int n;
 
-void printArrays(int array1[n][n], int array2[n][n], int arrayOut[n][n])
+void printArrays(const Matrix &array1, const Matrix &array2, const Matrix &arrayOut)
 {
 	cout << "Input Array 1\n[";
 
@@ -52,7 +55,7 @@ void printArrays(int array1[n][n], int array2[n][n], int arrayOut[n][n])
 	cout << "]\n\n";
 }		//Prints the three arrays, In1 in2 and out
 
-void intialiseArray(int array[n][n]) {
+void intialiseArray(Matrix &array) {
 	for (int i = 0; i < n; i++)
 	{
 		for (int j = 0; j < n; j++)
@@ -63,7 +66,7 @@ void intialiseArray(int array[n][n]) {
 
 }		//intialises a random array of n x n size
 
-int calculateCellValue(int i, int j, int array1[n][n], int array2[n][n])
+int calculateCellValue(int i, int j, const Matrix &array1, const Matrix &array2)
 {
                         int value = 0;
                         for (int k = 0; k < n; k++)
@@ -73,9 +76,8 @@ int calculateCellValue(int i, int j, int array1[n][n], int array2[n][n])
                         return value;
 }		//perform the calculation for a particualar cell
 
-void SequentialMatrixMultiplication(int array1[n][n], int array2[n][n], int arrayOut[n][n])
+void SequentialMatrixMultiplication(const Matrix &array1, const Matrix &array2, Matrix &arrayOut)
 {
-	int value;
 	for (int i = 0; i < n; i++)
 	{
 		for (int j = 0; j < n; j++)
@@ -85,15 +87,13 @@ void SequentialMatrixMultiplication(int array1[n][n], int array2[n][n], int arra
 	}
 }		//performs the iteration throught the arrays
 
-int main()
+int main(int argc, char *argv[])
 {
-	//int n = rand() % ((100 - 1) + 1) + 1; //not allowed in C++ language
-	
-	pthread_t threads[NUM_THREADS];
+	n = parseSize(argc, argv, 1, DEFAULT_N);		//runtime size, the matrices live on the heap instead of the stack
 
-	int inputArray1[n][n];
-	int inputArray2[n][n];
-	int OutputArray[n][n];
+	Matrix inputArray1 = createMatrix(n, n);
+	Matrix inputArray2 = createMatrix(n, n);
+	Matrix OutputArray = createMatrix(n, n);
 
 	cout << "pthread using " << NUM_THREADS << " threads" << endl;
 
@@ -108,7 +108,12 @@ int main()
 		//printArrays(inputArray1, inputArray2, OutputArray);
 		cout << (stop_s - start_s) / double(CLOCKS_PER_SEC) * 1000 << endl;
 	}
+
+	freeMatrix(inputArray1);
+	freeMatrix(inputArray2);
+	freeMatrix(OutputArray);
 }
 
 // g++ <file.cpp>
 // g++ -o <name> <file.cpp>
+// ./<name> 2000
@@ -0,0 +1,323 @@
+/* sparse.h
+ *
+ * Compressed sparse row (CSR) matrices and the sparse multiply paths that sit next to the dense
+ * kernels in gemm.h. A CSR matrix keeps only the non zeros, row by row: values[] and colIndex[] hold
+ * them in row order and row i owns entries rowStart[i] .. rowStart[i + 1] - 1.
+ *
+ *	spmmMultiply		sparse A x dense B -> dense C, each non zero of A adds a scaled row of B
+ *	spgemmMultiply		sparse A x sparse B -> dense C, Gustavson's row by row algorithm
+ *	spgemm			sparse A x sparse B -> sparse C, the same with a per thread sparse
+ *				accumulator so neither work nor memory ever touches N^2
+ *
+ * adaptiveMatrixMultiply takes dense matrices and fills a dense C whatever path it picks.
+ * adaptiveSparseMultiply is the CSR in, CSR out version: on the Gustavson path it calls spgemm, so
+ * nothing N x N is ever allocated; only inputs too dense for that are expanded and run densely.
+ * csrMatchesDense compares a CSR result element by element with a dense reference.
+ *
+ * Row by row CSR gives B's rows directly, which is all Gustavson needs, so there is no CSC form.
+ * adaptiveMatrixMultiply counts the non zeros of A and B and picks a path at runtime: Gustavson
+ * costs about density(A) * density(B) * N^3 scalar multiply-adds and SpMM density(A) * N^3 vector
+ * ones, against N^3 for the SIMD blocked kernel, so the thresholds below leave room for the sparse
+ * loops being several times slower per operation.
+ */
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "gemm.h"
+
+#define SPARSE_SPMM_DENSITY 0.10		//A at or below this density uses SpMM against dense B
+#define SPARSE_SPGEMM_DENSITY 0.02		//density(A) * density(B) at or below this uses Gustavson
+
+template <typename T>
+struct CsrMatrix {
+	int rows;
+	int cols;
+	long nnz;
+	long *rowStart;			//rows + 1 offsets into colIndex / values
+	int *colIndex;
+	T *values;
+};
+
+template <typename T>
+inline CsrMatrix<T> createCsr(int rows, int cols, long nnz)
+{
+	CsrMatrix<T> m;
+	m.rows = rows;
+	m.cols = cols;
+	m.nnz = nnz;
+	m.rowStart = (long *)malloc((rows + 1) * sizeof(long));
+	m.colIndex = (int *)malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+	m.values = (T *)malloc((nnz > 0 ? nnz : 1) * sizeof(T));
+	if (!m.rowStart || !m.colIndex || !m.values) {
+		fprintf(stderr, "Couldn't allocate a %d x %d sparse matrix with %ld non zeros\n", rows, cols, nnz);
+		exit(1);
+	}
+	return m;
+}		//rowStart is left for the caller to fill
+
+template <typename T>
+inline void freeCsr(CsrMatrix<T> &m)
+{
+	free(m.rowStart);
+	free(m.colIndex);
+	free(m.values);
+	m.rowStart = NULL;
+	m.colIndex = NULL;
+	m.values = NULL;
+	m.rows = m.cols = 0;
+	m.nnz = 0;
+}
+
+template <typename T>
+inline void countRowNonZeros(const BasicMatrix<T> &m, long *counts)
+{
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < m.rows; i++) {
+		const T *row = m[i];
+		long count = 0;
+		for (int j = 0; j < m.cols; j++) count += row[j] != 0;
+		counts[i] = count;
+	}
+}		//non zeros of every row, one streaming pass shared out between OpenMP threads
+
+inline long prefixSum(long *counts, int n)
+{
+	long total = 0;
+	for (int i = 0; i < n; i++) {
+		long count = counts[i];
+		counts[i] = total;
+		total += count;
+	}
+	counts[n] = total;
+	return total;
+}		//turns n counts into n + 1 start offsets in place, returns the total
+
+template <typename T>
+inline CsrMatrix<T> csrFromRowCounts(const BasicMatrix<T> &m, long *counts)
+{
+	long nnz = prefixSum(counts, m.rows);
+	CsrMatrix<T> s = createCsr<T>(m.rows, m.cols, nnz);
+	memcpy(s.rowStart, counts, (m.rows + 1) * sizeof(long));
+
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < m.rows; i++) {
+		const T *row = m[i];
+		long k = s.rowStart[i];
+		for (int j = 0; j < m.cols; j++) {
+			if (row[j] != 0) {
+				s.colIndex[k] = j;
+				s.values[k] = row[j];
+				k++;
+			}
+		}
+	}
+	return s;
+}		//builds the CSR form from per row counts (counts needs rows + 1 entries and is overwritten)
+
+template <typename T>
+inline CsrMatrix<T> csrFromDense(const BasicMatrix<T> &m)
+{
+	std::vector<long> counts(m.rows + 1);
+	countRowNonZeros(m, counts.data());
+	return csrFromRowCounts(m, counts.data());
+}		//CSR copy of a dense matrix, explicit zeros are dropped
+
+template <typename In, typename Acc>
+inline void spmmMultiply(const CsrMatrix<In> &A, const BasicMatrix<In> &B, BasicMatrix<Acc> &C)
+{
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (int i = 0; i < A.rows; i++) {
+		Acc *c = C[i];
+		for (int j = 0; j < C.cols; j++) c[j] = 0;
+		for (long k = A.rowStart[i]; k < A.rowStart[i + 1]; k++) {
+			Acc a = (Acc)A.values[k];
+			const In *b = B[A.colIndex[k]];
+			#pragma omp simd
+			for (int j = 0; j < C.cols; j++) c[j] += a * (Acc)b[j];
+		}
+	}
+}		//C = A * B with only A sparse, the inner loop is a contiguous vector update of row i of C
+
+template <typename In, typename Acc>
+inline void spgemmMultiply(const CsrMatrix<In> &A, const CsrMatrix<In> &B, BasicMatrix<Acc> &C)
+{
+	#pragma omp parallel for schedule(dynamic, 16)
+	for (int i = 0; i < A.rows; i++) {
+		Acc *c = C[i];
+		for (int j = 0; j < C.cols; j++) c[j] = 0;
+		for (long k = A.rowStart[i]; k < A.rowStart[i + 1]; k++) {
+			Acc a = (Acc)A.values[k];
+			int row = A.colIndex[k];
+			for (long l = B.rowStart[row]; l < B.rowStart[row + 1]; l++) c[B.colIndex[l]] += a * (Acc)B.values[l];
+		}
+	}
+}		//C = A * B with both sparse, row i of C is scattered straight into the dense output
+
+template <typename In, typename Acc>
+inline long spgemmRow(const CsrMatrix<In> &A, const CsrMatrix<In> &B, int i, Acc *accumulator, int *marker, int *touched)
+{
+	long found = 0;
+	for (long k = A.rowStart[i]; k < A.rowStart[i + 1]; k++) {
+		Acc a = (Acc)A.values[k];
+		int row = A.colIndex[k];
+		for (long l = B.rowStart[row]; l < B.rowStart[row + 1]; l++) {
+			int j = B.colIndex[l];
+			if (marker[j] != i) {
+				marker[j] = i;
+				accumulator[j] = 0;
+				touched[found++] = j;
+			}
+			accumulator[j] += a * (Acc)B.values[l];
+		}
+	}
+	return found;
+}		//accumulates row i of A * B into accumulator, touched lists the columns reached (unsorted)
+
+template <typename In, typename Acc>
+inline CsrMatrix<Acc> spgemm(const CsrMatrix<In> &A, const CsrMatrix<In> &B)
+{
+	std::vector<long> counts(A.rows + 1);
+	CsrMatrix<Acc> C;
+
+	#pragma omp parallel
+	{
+		std::vector<Acc> accumulator(B.cols);
+		std::vector<int> marker(B.cols, -1);
+		std::vector<int> touched(B.cols);
+
+		#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < A.rows; i++) counts[i] = spgemmRow(A, B, i, accumulator.data(), marker.data(), touched.data());
+			//symbolic pass, counts the structural non zeros of each row of C
+
+		#pragma omp single
+		{
+			long nnz = prefixSum(counts.data(), A.rows);
+			C = createCsr<Acc>(A.rows, B.cols, nnz);
+			memcpy(C.rowStart, counts.data(), (A.rows + 1) * sizeof(long));
+		}		//implicit barrier, every thread sees C before the numeric pass
+
+		for (size_t j = 0; j < marker.size(); j++) marker[j] = -1;
+		#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < A.rows; i++) {
+			long found = spgemmRow(A, B, i, accumulator.data(), marker.data(), touched.data());
+			std::sort(touched.begin(), touched.begin() + found);
+			long k = C.rowStart[i];
+			for (long t = 0; t < found; t++, k++) {
+				C.colIndex[k] = touched[t];
+				C.values[k] = accumulator[touched[t]];
+			}
+		}		//numeric pass writes each row into its own slice, columns sorted
+	}
+	return C;
+}		//C = A * B kept sparse, work and memory scale with the non zeros and the products formed
+
+template <typename In, typename Acc>
+inline const char *adaptiveMatrixMultiply(const BasicMatrix<In> &A, const BasicMatrix<In> &B, BasicMatrix<Acc> &C, const BlockSizes &bs)
+{
+	std::vector<long> countsA(A.rows + 1), countsB(B.rows + 1);
+	countRowNonZeros(A, countsA.data());
+	long nnzA = 0;
+	for (int i = 0; i < A.rows; i++) nnzA += countsA[i];
+	double densityA = (double)nnzA / ((double)A.rows * A.cols);
+
+	if (densityA > SPARSE_SPMM_DENSITY) {
+		openmpBlockedMatrixMultiply(A, B, C, bs);
+		return "dense";
+	}		//B is only counted once A is known to be sparse enough to matter
+
+	countRowNonZeros(B, countsB.data());
+	long nnzB = 0;
+	for (int i = 0; i < B.rows; i++) nnzB += countsB[i];
+	double densityB = (double)nnzB / ((double)B.rows * B.cols);
+
+	CsrMatrix<In> sparseA = csrFromRowCounts(A, countsA.data());
+	const char *path;
+	if (densityA * densityB <= SPARSE_SPGEMM_DENSITY) {
+		CsrMatrix<In> sparseB = csrFromRowCounts(B, countsB.data());
+		spgemmMultiply(sparseA, sparseB, C);
+		freeCsr(sparseB);
+		path = "spgemm";
+	} else {
+		spmmMultiply(sparseA, B, C);
+		path = "spmm";
+	}
+	freeCsr(sparseA);
+	return path;
+}		//C = A * B on the dense, SpMM or Gustavson path depending on the measured densities, returns the path taken
+
+template <typename T>
+inline double csrDensity(const CsrMatrix<T> &m)
+{
+	return (double)m.nnz / ((double)m.rows * m.cols);
+}
+
+template <typename T>
+inline BasicMatrix<T> denseFromCsr(const CsrMatrix<T> &m)
+{
+	BasicMatrix<T> d = createMatrixOf<T>(m.rows, m.cols);
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < m.rows; i++) {
+		T *row = d[i];
+		for (int j = 0; j < m.cols; j++) row[j] = 0;
+		for (long k = m.rowStart[i]; k < m.rowStart[i + 1]; k++) row[m.colIndex[k]] = m.values[k];
+	}
+	return d;
+}		//dense copy of a CSR matrix, only used once the inputs are too dense for the sparse paths
+
+template <typename In, typename Acc>
+inline const char *adaptiveSparseMultiply(const CsrMatrix<In> &A, const CsrMatrix<In> &B, CsrMatrix<Acc> &C, const BlockSizes &bs)
+{
+	double densityA = csrDensity(A), densityB = csrDensity(B);
+	if (densityA * densityB <= SPARSE_SPGEMM_DENSITY) {
+		C = spgemm<In, Acc>(A, B);
+		return "spgemm-csr";
+	}		//the only path that stays O(nnz), the others need a dense C anyway
+
+	BasicMatrix<In> denseB = denseFromCsr(B);
+	BasicMatrix<Acc> denseC = createMatrixOf<Acc>(A.rows, B.cols);
+	const char *path;
+	if (densityA > SPARSE_SPMM_DENSITY) {
+		BasicMatrix<In> denseA = denseFromCsr(A);
+		openmpBlockedMatrixMultiply(denseA, denseB, denseC, bs);
+		freeMatrix(denseA);
+		path = "dense-csr";
+	} else {
+		spmmMultiply(A, denseB, denseC);
+		path = "spmm-csr";
+	}
+	C = csrFromDense(denseC);
+	freeMatrix(denseB);
+	freeMatrix(denseC);
+	return path;
+}		//C = A * B with CSR inputs and output, same thresholds as adaptiveMatrixMultiply, returns the path taken; free C with freeCsr
+
+template <typename Acc>
+inline bool csrMatchesDense(const CsrMatrix<Acc> &C, const BasicMatrix<Acc> &reference, int inner)
+{
+	if (C.rows != reference.rows || C.cols != reference.cols) return false;
+	double epsilon = std::is_same<Acc, float>::value ? FLT_EPSILON : DBL_EPSILON;
+	double tolerance = std::is_floating_point<Acc>::value ? 4 * inner * epsilon : 0;
+	bool match = true;
+
+	#pragma omp parallel for schedule(static) reduction(&&:match)
+	for (int i = 0; i < C.rows; i++) {
+		const Acc *row = reference[i];
+		long k = C.rowStart[i];
+		for (int j = 0; j < C.cols; j++) {
+			Acc value = k < C.rowStart[i + 1] && C.colIndex[k] == j ? C.values[k++] : 0;
+			double expected = (double)row[j], actual = (double)value;
+			if (fabs(expected - actual) > tolerance * (fabs(expected) + fabs(actual))) match = false;
+		}
+		if (k != C.rowStart[i + 1]) match = false;		//columns out of order or out of range
+	}
+	return match;
+}		//every element of C equal to the reference, exactly for the integer types and within rounding for float and double
+
+#endif
@@ -0,0 +1,213 @@
+/* strassen.h
+ *
+ * Strassen-Winograd multiplication for large square matrices, C = A * B.
+ * Each level does 7 half size multiplies and 15 additions instead of 8 multiplies. Recursion stops
+ * at a tunable cutoff and the leaves go to the blocked kernel from gemm.h.
+ *
+ * Sizes that do not halve evenly are zero padded once, at the top, to leaf * 2^levels where leaf is
+ * the smallest size <= cutoff that works, so the padding is always less than 2^levels rows and columns.
+ * All temporaries come out of one scratch arena allocated up front. Per level that is 8 operand sums
+ * and 3 products (the other 4 products are written straight into the quadrants of C).
+ *
+ * The 7 products of the top taskDepth levels run as OpenMP tasks; every task gets its own slice of
+ * the arena, so the arena grows by roughly 7x per task level.
+ *
+ * Templated over the element type T for the types that accumulate in themselves (int, float, double).
+ * The int8 and int16 inputs are not supported: the operand sums would overflow the narrow type.
+ */
+
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include "gemm.h"
+#include <omp.h>
+
+struct StrassenOptions {
+	int cutoff;			//largest size multiplied directly by the blocked kernel
+	int taskDepth;			//levels whose 7 products run as parallel tasks
+	BlockSizes bs;			//block sizes for the leaves
+};
+
+inline StrassenOptions defaultStrassenOptions(int numThreads)
+{
+	StrassenOptions opt;
+	opt.cutoff = 512;
+	opt.taskDepth = numThreads > 7 ? 2 : (numThreads > 1 ? 1 : 0);
+	opt.bs = defaultBlockSizes();
+	return opt;
+}
+
+template <typename T>
+inline BasicMatrix<T> arenaMatrix(T *&arena, int n)
+{
+	BasicMatrix<T> m;
+	m.rows = m.cols = n;
+	m.stride = matrixStride<T>(n);
+	m.data = arena;
+	arena += m.size();
+	return m;
+}		//carves an n x n matrix off the front of the arena
+
+template <typename T>
+inline size_t strassenScratchSize(int n, int levels, int taskDepth)
+{
+	if (levels == 0) return 0;
+	int h = n / 2;
+	size_t q = (size_t)h * matrixStride<T>(h);
+	size_t child = strassenScratchSize<T>(h, levels - 1, taskDepth - 1);
+	return 11 * q + (taskDepth > 0 ? 7 : 1) * child;
+}		//elements needed below a level of size n
+
+template <typename T>
+inline void addMatrix(const BasicMatrix<T> &x, const BasicMatrix<T> &y, BasicMatrix<T> &out)
+{
+	for (int i = 0; i < out.rows; i++) {
+		const T *xr = x[i], *yr = y[i];
+		T *o = out[i];
+		for (int j = 0; j < out.cols; j++) o[j] = xr[j] + yr[j];
+	}
+}
+
+template <typename T>
+inline void subtractMatrix(const BasicMatrix<T> &x, const BasicMatrix<T> &y, BasicMatrix<T> &out)
+{
+	for (int i = 0; i < out.rows; i++) {
+		const T *xr = x[i], *yr = y[i];
+		T *o = out[i];
+		for (int j = 0; j < out.cols; j++) o[j] = xr[j] - yr[j];
+	}
+}
+
+template <typename T>
+inline void strassenRecurse(const BasicMatrix<T> &A, const BasicMatrix<T> &B, BasicMatrix<T> &C, int levels, int taskDepth, T *arena, const StrassenOptions &opt)
+{
+	if (levels == 0) {
+		blockedMatrixMultiplyTile(A, B, C, 0, C.rows, 0, C.cols, opt.bs, threadPackBuffer<PackedOf<T, T> >(opt.bs));
+		return;
+	}
+
+	int h = A.rows / 2;
+	BasicMatrix<T> A11 = subMatrix(A, 0, 0, h, h), A12 = subMatrix(A, 0, h, h, h), A21 = subMatrix(A, h, 0, h, h), A22 = subMatrix(A, h, h, h, h);
+	BasicMatrix<T> B11 = subMatrix(B, 0, 0, h, h), B12 = subMatrix(B, 0, h, h, h), B21 = subMatrix(B, h, 0, h, h), B22 = subMatrix(B, h, h, h, h);
+	BasicMatrix<T> C11 = subMatrix(C, 0, 0, h, h), C12 = subMatrix(C, 0, h, h, h), C21 = subMatrix(C, h, 0, h, h), C22 = subMatrix(C, h, h, h, h);
+
+	BasicMatrix<T> S1 = arenaMatrix(arena, h), S2 = arenaMatrix(arena, h), S3 = arenaMatrix(arena, h), S4 = arenaMatrix(arena, h);
+	BasicMatrix<T> T1 = arenaMatrix(arena, h), T2 = arenaMatrix(arena, h), T3 = arenaMatrix(arena, h), T4 = arenaMatrix(arena, h);
+	BasicMatrix<T> P1 = arenaMatrix(arena, h), P6 = arenaMatrix(arena, h), P7 = arenaMatrix(arena, h);
+
+	addMatrix(A21, A22, S1);		//S1 = A21 + A22
+	subtractMatrix(S1, A11, S2);		//S2 = S1 - A11
+	subtractMatrix(A11, A21, S3);		//S3 = A11 - A21
+	subtractMatrix(A12, S2, S4);		//S4 = A12 - S2
+	subtractMatrix(B12, B11, T1);		//T1 = B12 - B11
+	subtractMatrix(B22, T1, T2);		//T2 = B22 - T1
+	subtractMatrix(B22, B12, T3);		//T3 = B22 - B12
+	subtractMatrix(T2, B21, T4);		//T4 = T2 - B21
+
+	size_t child = strassenScratchSize<T>(h, levels - 1, taskDepth - 1);
+	if (taskDepth > 0) {
+		#pragma omp task
+		strassenRecurse(A11, B11, P1, levels - 1, taskDepth - 1, arena, opt);			//M1
+		#pragma omp task
+		strassenRecurse(A12, B21, C11, levels - 1, taskDepth - 1, arena + child, opt);		//M2
+		#pragma omp task
+		strassenRecurse(S4, B22, C12, levels - 1, taskDepth - 1, arena + 2 * child, opt);	//M3
+		#pragma omp task
+		strassenRecurse(A22, T4, C21, levels - 1, taskDepth - 1, arena + 3 * child, opt);	//M4
+		#pragma omp task
+		strassenRecurse(S1, T1, C22, levels - 1, taskDepth - 1, arena + 4 * child, opt);	//M5
+		#pragma omp task
+		strassenRecurse(S2, T2, P6, levels - 1, taskDepth - 1, arena + 5 * child, opt);		//M6
+		#pragma omp task
+		strassenRecurse(S3, T3, P7, levels - 1, taskDepth - 1, arena + 6 * child, opt);		//M7
+		#pragma omp taskwait
+	} else {
+		strassenRecurse(A11, B11, P1, levels - 1, 0, arena, opt);
+		strassenRecurse(A12, B21, C11, levels - 1, 0, arena, opt);
+		strassenRecurse(S4, B22, C12, levels - 1, 0, arena, opt);
+		strassenRecurse(A22, T4, C21, levels - 1, 0, arena, opt);
+		strassenRecurse(S1, T1, C22, levels - 1, 0, arena, opt);
+		strassenRecurse(S2, T2, P6, levels - 1, 0, arena, opt);
+		strassenRecurse(S3, T3, P7, levels - 1, 0, arena, opt);
+	}		//below the task levels the products run one after another and reuse the same scratch
+
+	for (int i = 0; i < h; i++) {
+		const T *p1 = P1[i], *p6 = P6[i], *p7 = P7[i];
+		T *c11 = C11[i], *c12 = C12[i], *c21 = C21[i], *c22 = C22[i];
+		for (int j = 0; j < h; j++) {
+			T u2 = p1[j] + p6[j];
+			T u3 = u2 + p7[j];
+			T m5 = c22[j];
+			c11[j] = p1[j] + c11[j];		//C11 = M1 + M2
+			c12[j] = u2 + m5 + c12[j];		//C12 = M1 + M6 + M5 + M3
+			c21[j] = u3 - c21[j];			//C21 = M1 + M6 + M7 - M4
+			c22[j] = u3 + m5;			//C22 = M1 + M6 + M7 + M5
+		}
+	}		//one pass combines the 7 products
+}		//C = A * B for n x n views, n = leaf * 2^levels
+
+inline void strassenPlan(int n, int cutoff, int &levels, int &padded)
+{
+	if (cutoff < 16) cutoff = 16;
+	levels = 0;
+	int leaf = n;
+	while (leaf > cutoff) {
+		levels++;
+		leaf = (n + (1 << levels) - 1) >> levels;
+	}
+	padded = leaf << levels;
+}		//fewest halvings that bring the leaf under the cutoff, padded = leaf * 2^levels >= n
+
+template <typename T>
+inline BasicMatrix<T> padMatrix(const BasicMatrix<T> &m, int padded)
+{
+	BasicMatrix<T> p = createMatrixOf<T>(padded, padded);
+	for (int i = 0; i < padded; i++) {
+		T *row = p[i];
+		int j = 0;
+		if (i < m.rows) for (; j < m.cols; j++) row[j] = m[i][j];
+		for (; j < padded; j++) row[j] = 0;
+	}
+	return p;
+}		//copy of m zero padded to padded x padded
+
+template <typename T>
+inline void strassenMatrixMultiply(const BasicMatrix<T> &A, const BasicMatrix<T> &B, BasicMatrix<T> &C, StrassenOptions opt)
+{
+	int n = A.rows;
+	opt.bs = checkBlockSizes(opt.bs);
+	if (A.cols != n || B.rows != n || B.cols != n) {
+		openmpBlockedMatrixMultiply(A, B, C, opt.bs);
+		return;
+	}		//only square problems are recursed
+
+	int levels, padded;
+	strassenPlan(n, opt.cutoff, levels, padded);
+	if (opt.taskDepth > levels) opt.taskDepth = levels;
+
+	bool pad = padded != n;
+	BasicMatrix<T> Ap = pad ? padMatrix(A, padded) : A;
+	BasicMatrix<T> Bp = pad ? padMatrix(B, padded) : B;
+	BasicMatrix<T> Cp = pad ? createMatrixOf<T>(padded, padded) : C;
+
+	size_t scratch = strassenScratchSize<T>(padded, levels, opt.taskDepth);
+	T *arena = NULL;
+	if (scratch > 0 && posix_memalign((void **)&arena, MATRIX_ALIGN, scratch * sizeof(T)) != 0) {
+		fprintf(stderr, "Couldn't allocate %zu MB of Strassen scratch\n", scratch * sizeof(T) >> 20);
+		exit(1);
+	}
+
+	#pragma omp parallel
+	#pragma omp single
+	strassenRecurse(Ap, Bp, Cp, levels, opt.taskDepth, arena, opt);
+
+	if (pad) {
+		for (int i = 0; i < n; i++) memcpy(C[i], Cp[i], n * sizeof(T));
+		freeMatrix(Ap);
+		freeMatrix(Bp);
+		freeMatrix(Cp);
+	}
+	free(arena);
+}		//square multiply by Strassen-Winograd, non square shapes fall back to the OpenMP blocked kernel
+
+#endif
@@ -0,0 +1,198 @@
+/* threadPool.h
+ *
+ * Persistent pthread pool that runs jobs made of independent tiles.
+ * The threads are created once and sleep on a condition variable between jobs, so repeated
+ * multiplies do not pay for pthread_create/pthread_join every time.
+ *
+ * Each job's tiles are split into one contiguous range per worker. A worker takes tiles from the
+ * front of its own range and, once that is empty, steals the back half of another worker's range,
+ * so a slow or preempted core only holds on to the tile it is currently working on.
+ *
+ * Workers can be bound to CPUs when the pool is created (see pinOrder in affinity.h); worker w gets
+ * cpus[w % numCpus], the same CPU as OpenMP thread w, so both variants see the same page placement.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+typedef void (*TileTask)(int tile, int worker, void *arg);
+
+struct TileQueue {
+	pthread_mutex_t lock;
+	int head;			//next tile the owner takes
+	int tail;			//one past the last tile, thieves take from here
+	char pad[64];			//keeps neighbouring queues off the same cache line
+};
+
+struct ThreadPool {
+	int numThreads;
+	int pinned;			//workers bound to a CPU, 0 when the pool was created without a CPU list
+	pthread_t *threads;
+	TileQueue *queues;
+
+	pthread_mutex_t mutx;
+	pthread_cond_t wake;		//signalled when a new job is posted or the pool stops
+	pthread_cond_t done;		//signalled when the last worker finishes a job
+	long generation;		//bumped once per job
+	int active;			//workers still running the current job
+	bool stop;
+
+	TileTask task;
+	void *arg;
+};
+
+struct WorkerStart {
+	ThreadPool *pool;
+	int worker;
+};
+
+inline int takeTile(TileQueue &queue)
+{
+	int tile = -1;
+	pthread_mutex_lock(&queue.lock);
+	if (queue.head < queue.tail) tile = queue.head++;
+	pthread_mutex_unlock(&queue.lock);
+	return tile;
+}		//owner side, takes from the front so a worker walks its own range in order
+
+inline int stealTiles(ThreadPool *pool, int worker)
+{
+	for (int i = 1; i < pool->numThreads; i++) {
+		TileQueue &victim = pool->queues[(worker + i) % pool->numThreads];
+		int first = -1, last = -1;
+
+		pthread_mutex_lock(&victim.lock);
+		int left = victim.tail - victim.head;
+		if (left > 0) {
+			int take = (left + 1) / 2;
+			last = victim.tail;
+			first = victim.tail - take;
+			victim.tail = first;
+		}
+		pthread_mutex_unlock(&victim.lock);
+
+		if (first >= 0) {
+			TileQueue &own = pool->queues[worker];
+			pthread_mutex_lock(&own.lock);
+			own.head = first + 1;
+			own.tail = last;
+			pthread_mutex_unlock(&own.lock);
+			return first;
+		}
+	}
+	return -1;
+}		//thief side, moves the back half of the first non empty queue into our own and returns its first tile
+
+inline void runWorker(ThreadPool *pool, int worker)
+{
+	int tile;
+	while ((tile = takeTile(pool->queues[worker])) >= 0 || (tile = stealTiles(pool, worker)) >= 0) {
+		pool->task(tile, worker, pool->arg);
+	}
+}		//no tiles are added once a job starts, so when every queue is empty the job is finished for this worker
+
+inline void *poolWorker(void *start)
+{
+	WorkerStart *ws = (WorkerStart *)start;
+	ThreadPool *pool = ws->pool;
+	int worker = ws->worker;
+	free(ws);
+
+	long seen = 0;
+	pthread_mutex_lock(&pool->mutx);
+	while (true) {
+		while (!pool->stop && pool->generation == seen) pthread_cond_wait(&pool->wake, &pool->mutx);
+		if (pool->stop) break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->mutx);
+
+		runWorker(pool, worker);
+
+		pthread_mutex_lock(&pool->mutx);
+		if (--pool->active == 0) pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mutx);
+	return NULL;
+}		//sleeps between jobs, runs tiles until the job is drained
+
+inline ThreadPool *createThreadPool(int numThreads, const int *cpus = NULL, int numCpus = 0)
+{
+	if (numThreads < 1) numThreads = 1;
+
+	ThreadPool *pool = new ThreadPool();
+	pool->numThreads = numThreads;
+	pool->pinned = 0;
+	pool->threads = new pthread_t[numThreads];
+	pool->queues = new TileQueue[numThreads];
+	pool->generation = 0;
+	pool->active = 0;
+	pool->stop = false;
+	pool->task = NULL;
+	pool->arg = NULL;
+	pthread_mutex_init(&pool->mutx, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (int w = 0; w < numThreads; w++) {
+		pthread_mutex_init(&pool->queues[w].lock, NULL);
+		pool->queues[w].head = pool->queues[w].tail = 0;
+	}
+	for (int w = 0; w < numThreads; w++) {
+		WorkerStart *ws = (WorkerStart *)malloc(sizeof(WorkerStart));
+		ws->pool = pool;
+		ws->worker = w;
+		pthread_create(&pool->threads[w], NULL, poolWorker, ws);
+		if (numCpus > 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpus[w % numCpus], &set);
+			if (pthread_setaffinity_np(pool->threads[w], sizeof(set), &set) == 0) pool->pinned++;
+		}		//bound before the first job, so the worker's packing buffer is allocated on its own node
+	}
+	return pool;
+}		//starts numThreads workers that wait for jobs, pinned to cpus when a list is given
+
+inline void runTiles(ThreadPool *pool, int numTiles, TileTask task, void *arg)
+{
+	pthread_mutex_lock(&pool->mutx);
+	pool->task = task;
+	pool->arg = arg;
+	for (int w = 0; w < pool->numThreads; w++) {
+		TileQueue &queue = pool->queues[w];
+		pthread_mutex_lock(&queue.lock);
+		queue.head = (int)((long)numTiles * w / pool->numThreads);
+		queue.tail = (int)((long)numTiles * (w + 1) / pool->numThreads);
+		pthread_mutex_unlock(&queue.lock);
+	}
+	pool->active = pool->numThreads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+
+	while (pool->active > 0) pthread_cond_wait(&pool->done, &pool->mutx);
+	pthread_mutex_unlock(&pool->mutx);
+}		//runs task(tile, worker, arg) for every tile in 0..numTiles and returns when all of them are done
+
+inline void destroyThreadPool(ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->mutx);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->mutx);
+
+	for (int w = 0; w < pool->numThreads; w++) {
+		pthread_join(pool->threads[w], NULL);
+		pthread_mutex_destroy(&pool->queues[w].lock);
+	}
+	pthread_mutex_destroy(&pool->mutx);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
+	delete[] pool->queues;
+	delete[] pool->threads;
+	delete pool;
+}		//wakes the workers with stop set and joins them
+
+#endif
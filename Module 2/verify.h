@@ -0,0 +1,92 @@
+/* verify.h
+ *
+ * Freivalds' check that C == A * B without redoing the multiply.
+ * Each round picks a random vector r and compares A * (B * r) with C * r, which is O(N^2) instead
+ * of O(N^3). A wrong C survives one round with probability at most 1/2, so k rounds miss an error
+ * with probability at most 2^-k.
+ *
+ * All rounds are done together: the random vectors form an N x rounds block R, so A, B and C are
+ * each streamed from memory once however many rounds are asked for. For the integer types arithmetic
+ * is modulo 2^32 like the int32 accumulators, so results that wrapped around still verify. float and
+ * double results are checked in double against a relative tolerance that grows with the inner
+ * dimension, sized for the non negative inputs the programs generate.
+ * The programs seed the random vectors from the clock (verifySeed), so every run checks against
+ * different vectors, and print the seed; --verify-seed= repeats the vectors of a failed run.
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <type_traits>
+#include <time.h>
+#include "matrix.h"
+
+#define VERIFY_DEFAULT_ROUNDS 10
+
+inline unsigned verifySeed(int argc, char *argv[])
+{
+	return (unsigned)parseOption(argc, argv, "--verify-seed", (int)time(NULL));
+}		//a new seed every second unless --verify-seed= pins it
+
+template <typename Acc>
+using VerifyWord = typename std::conditional<std::is_floating_point<Acc>::value, double, uint32_t>::type;
+		//what the products are formed in: wrapping uint32 for integers, double for floating point
+
+template <typename T, typename W>
+inline void multiplyVectors(const BasicMatrix<T> &M, const W *R, W *out, int rounds)
+{
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < M.rows; i++) {
+		const T *row = M[i];
+		W *o = out + (size_t)i * rounds;
+		for (int t = 0; t < rounds; t++) o[t] = 0;
+		for (int j = 0; j < M.cols; j++) {
+			W mij = (W)row[j];
+			const W *r = R + (size_t)j * rounds;
+			for (int t = 0; t < rounds; t++) o[t] += mij * r[t];
+		}
+	}
+}		//out (rows x rounds) = M * R (cols x rounds), rows are shared out between OpenMP threads
+
+inline bool sameProducts(const std::vector<uint32_t> &expected, const std::vector<uint32_t> &actual, double)
+{
+	return expected == actual;
+}		//integer results must match exactly
+
+inline bool sameProducts(const std::vector<double> &expected, const std::vector<double> &actual, double tolerance)
+{
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (fabs(expected[i] - actual[i]) > tolerance * (fabs(expected[i]) + fabs(actual[i])) + DBL_MIN) return false;
+	}
+	return true;
+}
+
+template <typename In, typename Acc>
+inline bool freivaldsVerify(const BasicMatrix<In> &A, const BasicMatrix<In> &B, const BasicMatrix<Acc> &C, int rounds, unsigned seed)
+{
+	typedef VerifyWord<Acc> W;
+	if (rounds < 1) return true;
+
+	std::vector<W> R((size_t)B.cols * rounds);
+	uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+	for (size_t i = 0; i < R.size(); i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		R[i] = std::is_floating_point<W>::value ? (W)((state >> 11) * 0x1.0p-53) : (W)(state >> 32);
+	}		//xorshift, rand() is shared with the matrix initialisation
+
+	std::vector<W> BR((size_t)B.rows * rounds), ABR((size_t)A.rows * rounds), CR((size_t)C.rows * rounds);
+	multiplyVectors(B, R.data(), BR.data(), rounds);
+	multiplyVectors(A, BR.data(), ABR.data(), rounds);
+	multiplyVectors(C, R.data(), CR.data(), rounds);
+
+	double epsilon = std::is_same<Acc, float>::value ? FLT_EPSILON : DBL_EPSILON;
+	return sameProducts(ABR, CR, 4 * epsilon * (A.cols + 1));
+}		//true when C passed every round, for integers a false result is always a real error
+
+#endif
@@ -2,79 +2,105 @@
 // Author: Om Tomar
 // Date: 09/03/24
 
-// Compile with 
-// $ mpicxx openclMPI.cpp -fopenmp -lOpenCL
+// Compile with
+// $ mpicxx -O3 OpenCLMPI.cpp -fopenmp -lOpenCL
 
 // Run
 // $ mpirun -np 4 --hostfile ~/Desktop/Slave.list
+// $ mpirun -np 4 ./a.out 2000 --ts=16 --warmup=1 --reps=5 --verify=10 --verify-seed=42 --format=csv --phases=scaling.csv
+// $ mpirun -np 2 ./a.out 2000 --device=cpu                      (CPU OpenCL such as POCL on GPU-less nodes)
+// $ POCL_MAX_PTHREAD_COUNT=4 mpirun -np 4 ./a.out 2000 --device=cpu   (one POCL thread per core between the ranks of a node)
 // $ mpirun -np 4 ./a.out
 
+// Every rank gets its own row strip of A (MPI_Scatterv) and the whole of B (MPI_Bcast), runs the
+// tiled kernel below on its strip only and the strips of C are gathered on the root. The kernel is
+// compiled into the program, TS x TS work groups stage a tile of A and a tile of B in local memory
+// and every work item accumulates one element of C over the tiles; TS is passed as a build option
+// (--ts=, default 16) and halved until the work group fits the device.
+// The compiled program is cached on disk (clBinaryCache.h). The first rank on each node builds it,
+// the others wait for it and load the cached binary instead of compiling the same kernel at once.
+
 #include<mpi.h>
 #include<stdlib.h>
 #include<unistd.h>
 #include<stdio.h>
-#include<sys/time.h>
+#include<string.h>
 #include<time.h>
 #include<omp.h>
 #include<CL/cl.h>
+#include "../../Module 2/matrix.h"
+#include "../../Module 2/gemm.h"
+#include "../../Module 2/benchmark.h"
+#include "../../Module 2/verify.h"
+#include "../../Module 2/clBinaryCache.h"
+#include "phases.h"
+#include "mpiMultiply.h"
+
+#define DEFAULT_N 800 // Default size of the matrices, override with the first argument
+#define DEFAULT_TS 16 // Default work group tile, TS x TS work items
 
-#define N 800 // Define the size of the matrices
+int N;
 
 using namespace std;
 
-void intialiseArray(int array[N][N]); // Function to initialize the array with random values
-void printArrays(int array[N][N]); // Function to print arrays to the console
-void openclMatrixMultiplication(int np, int rank, int inputArray1[N][N], int inputArray2[N][N], int outputArray[N][N]); // Function to perform matrix multiplication
-//void MatrixMultiplication(int np, int rank, int inputArray1[N][N], int inputArray2[N][N], int outputArray[N*N]);
-struct timeval timecheck;
+static const char *kernelSource = R"(
+__kernel void multiply_matrices(const int M, const int N, const int K, const int lda, const int ldb, const int ldc,
+                                __global const int *A, __global const int *B, __global int *C)
+{
+    const int col = get_global_id(0); // Dimension 0 runs along a row of C, neighbouring work items read neighbouring B
+    const int row = get_global_id(1);
+    const int lc = get_local_id(0);
+    const int lr = get_local_id(1);
+    __local int tileA[TS][TS];
+    __local int tileB[TS][TS];
+
+    int acc = 0;
+    for (int t = 0; t < K; t += TS) {
+        tileA[lr][lc] = row < M && t + lc < K ? A[row * lda + t + lc] : 0; // Zeros past the edge, so any N works
+        tileB[lr][lc] = t + lr < K && col < N ? B[(t + lr) * ldb + col] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (int k = 0; k < TS; k++) acc += tileA[lr][k] * tileB[k][lc];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (row < M && col < N) C[row * ldc + col] = acc;
+}
+)";
+
+void openclMatrixMultiplication(int np, int rank, const Matrix &inputArray1, const Matrix &inputArray2, Matrix &outputArray, PhaseTimes *times); // Function to perform matrix multiplication
 
 cl_device_id device_id;
 cl_context context;
 cl_program program;
 cl_kernel kernel;
-cl_command_queue  queue;
+cl_command_queue queue;
 
-cl_event event = NULL;
-int err;
-
-int a[N][N], b[N][N], c[N][N];
 cl_mem bufA, bufB, bufC;
-const int max = N;
-    const int TS = 4;
-    const size_t local[2] = { TS, TS };
-    const size_t global[2] = { max, max }; 
-void init (int a[N][N]);
-void matrix_mul(int a[N][N], int b[N][N], int c[N][N]) ;
-void print_matrix(int a[N][N]) ;
-
-cl_device_id create_device();
-cl_program build_program(cl_context ctx, cl_device_id dev, const char* filename);
-
-void setup_openCL_device_context_queue_kernel();
-void setup_kernel_memory();
-void copy_kernel_args();
+bool programCached; // Loaded from the binary cache instead of compiled
+int TS = DEFAULT_TS;
+size_t local[2];
+size_t global[2];
+
+void check(cl_int err, const char *what);
+cl_device_id create_device(const char *type);
+cl_program build_program(cl_context ctx, cl_device_id dev, const char *source, const char *options);
+
+void setup_openCL_device_context_queue_kernel(const char *type);
+void setup_kernel_memory(int rows);
+void copy_kernel_args(int rows);
 void free_memory();
 
-void printOutput(int outputArray[N]){
+void printOutput(const int outputArray[]){
     for (int i = 0 ; i < N; i++){
         printf(" %d :", outputArray[i]);
     }
-    
-}
-
 
-int main(){
+}
 
-    init(a);
-    init(b);
-    matrix_mul(a,b,c);
-    //print_matrix(c);
 
-    setup_openCL_device_context_queue_kernel();
-    setup_kernel_memory();
-    copy_kernel_args();
+int main(int argc, char *argv[]){
+    MPI_Init(&argc, &argv); // Before any OpenCL, every rank sets up its own device
 
-    MPI_Init(NULL, NULL);
+    N = parseSize(argc, argv, 1, DEFAULT_N); // Read the matrix size from argv
 
     int np = 0;
     MPI_Comm_size(MPI_COMM_WORLD, &np);     // Get the number of nodes
@@ -82,11 +108,35 @@ int main(){
     int rank = 0;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);    // Get the rank of the current process
 
-    int inputArray1[N][N], inputArray2[N][N];
-    int outputArray[N][N]={{0}};
-    //int outputArray[N*N]={0};
-
-
+    TS = parseOption(argc, argv, "--ts", DEFAULT_TS); // Work group tile edge
+    const char *deviceType = parseString(argc, argv, "--device", "any"); // gpu, cpu or any (a GPU when there is one)
+    int warmup = parseOption(argc, argv, "--warmup", 0); // Untimed repetitions
+    int reps = parseOption(argc, argv, "--reps", 1); // Timed repetitions
+    bool baseline = parseOption(argc, argv, "--baseline", 0) != 0; // Also time a single process CPU multiply on the root
+    const char *format = parseString(argc, argv, "--format", "csv");
+    int rounds = parseOption(argc, argv, "--verify", VERIFY_DEFAULT_ROUNDS); // Freivalds rounds on the gathered result, 0 to skip
+    unsigned seed = verifySeed(argc, argv); // Only the root verifies, --verify-seed= repeats its vectors
+    const char *phasesPath = parseString(argc, argv, "--phases", NULL); // Append the per-phase report here, stderr when not given
+
+    int start, end;
+    partitionRows(N, np, rank, start, end); // This rank's rows of A and C
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm); // Ranks that share a disk cache
+    int nodeRank;
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    double setupStart = MPI_Wtime();
+    if (nodeRank != 0) MPI_Barrier(nodeComm); // Wait for the node's first rank to fill the cache
+    setup_openCL_device_context_queue_kernel(deviceType);
+    if (nodeRank == 0) MPI_Barrier(nodeComm);
+    double setupMs = (MPI_Wtime() - setupStart) * 1000;
+    MPI_Comm_free(&nodeComm);
+    setup_kernel_memory(end - start);
+    copy_kernel_args(end - start);
+
+    Matrix inputArray1 = createMatrix(rank == 0 ? N : 0, N); // Declare input arrays on the heap, other ranks only hold their rows
+    Matrix inputArray2 = createMatrix(N, N); // Every rank needs all of inputArray2
+    Matrix outputArray = createMatrix(rank == 0 ? N : 0, N); // Only the root collects the full output
+    zeroMatrix(outputArray);
 
     if (rank==0) { // If it is the root process
         intialiseArray(inputArray1); // Initialize inputArray1
@@ -98,265 +148,203 @@ int main(){
         //printArrays(outputArray);
     }
 
-    //Timer Start
     if (rank == 0){
-        printf("OpenCL MPI Matrix Multiplication.\n");
+        char name[256] = "";
+        clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(name), name, NULL);
+        fprintf(stderr, "OpenCL MPI Matrix Multiplication (%s, TS %d, program %s in %.1f ms).\n", name, TS, programCached ? "loaded from cache" : "built", setupMs);
+        if (rounds > 0) fprintf(stderr, "verify seed %u.\n", seed);
     }
 
-    gettimeofday(&timecheck, NULL);
-	long timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
+    vector<double> samples;
+    PhaseTimes phases = createPhaseTimes(); // This rank's distribute, compute, collect and verify spans over the timed repetitions
+    for (int rep = 0; rep < warmup + reps; rep++) {
+        PhaseTimes *timed = rep >= warmup ? &phases : NULL;
+        MPI_Barrier(MPI_COMM_WORLD); // Start every repetition together
+        double start = MPI_Wtime();
+
+        MPI_Bcast(inputArray2.data, inputArray2.size(), MPI_INT, 0, MPI_COMM_WORLD); // Only inputArray2 is needed whole, inputArray1 is scattered by rows
+        addPhase(timed, PHASE_DISTRIBUTE, start, rank != 0 ? (double)inputArray2.size() * sizeof(int) : 0);
+        openclMatrixMultiplication(np, rank, inputArray1, inputArray2, outputArray, timed); // Perform matrix multiplication
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Bcast(&inputArray1, N*N, MPI_INT, 0, MPI_COMM_WORLD); // Broadcast inputArray1 to all processes
-    MPI_Bcast(&inputArray2, N*N, MPI_INT, 0, MPI_COMM_WORLD); // Broadcast inputArray2 to all processes
+        double elapsed = (MPI_Wtime() - start) * 1000, slowest = 0;
+        MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD); // A repetition lasts as long as its slowest rank
+        if (rep >= warmup) samples.push_back(slowest);
+    }
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    openclMatrixMultiplication(np, rank, inputArray1, inputArray2, outputArray); // Perform matrix multiplication
-    MPI_Barrier(MPI_COMM_WORLD);
-    
     //if(rank==0)printArrays(outputArray);
-    
-    MPI_Finalize(); // Finalize MPI
 
-    //Timer end
-    gettimeofday(&timecheck, NULL);
-	long timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
-	double time_elapsed = timeofday_end - timeofday_start;
-	
+    int verified = -1;
+    if (rank == 0 && rounds > 0) {
+        double start = MPI_Wtime();
+        verified = freivaldsVerify(inputArray1, inputArray2, outputArray, rounds, seed); // O(N^2) check instead of a sequential rerun
+        addPhase(&phases, PHASE_VERIFY, start);
+    }
+    PhaseStats phaseStats = reducePhases(MPI_COMM_WORLD, phases, reps, 0); // Min, max and mean over the ranks
+
     if (rank == 0){
-        printf("\t\tTime elapsed: %f ms\n", time_elapsed); // Print the time elapsed for the operation
+        double baselineMs = 0;
+        if (baseline) {
+            Matrix reference = createMatrix(N, N);
+            vector<double> sequential = timeRepetitions(warmup, reps, [&]() { blockedMatrixMultiply(inputArray1, inputArray2, reference, 0, N, defaultBlockSizes()); });
+            baselineMs = percentile(sequential, 0.5);
+            freeMatrix(reference);
+        }
+        char kernelName[32];
+        snprintf(kernelName, sizeof(kernelName), "opencl-ts%d", TS);
+        BenchResult result = summarise("mpi+opencl", N, np, kernelName, warmup, samples, baselineMs);
+        result.verified = verified;
+        printBenchHeader(stdout, format);
+        printBenchResult(stdout, format, result); // Print the timing summary
+        writePhaseReport(phasesPath, format, "mpi+opencl", N, np, reps, phaseStats); // One line per run for the scaling plots
     }
 
+    freeMatrix(inputArray1);
+    freeMatrix(inputArray2);
+    freeMatrix(outputArray);
+    free_memory();
+
+    MPI_Finalize(); // Finalize MPI
+
     return 0;
 }
 
-void intialiseArray(int array[N][N]) {
-	printf("intialising array... "); // Print message indicating initialization of the array
-	for (int i = 0; i < N; i++)
-	{
-		for (int j = 0; j < N; j++)
-		{
-			array[i][j] = rand() % ((10 - 1) + 1) + 1; // Assign random values to the array elements
-		}
-	}
-	printf("complete\n"); // Print message indicating completion of initialization
-}		//intialises array with random values, uses the N global variable
-
-void printArrays(int array[N][N]){
-	printf("["); // Print opening bracket for array
-	for (int i = 0; i < N; i++) {
-		printf("["); // Print opening bracket for inner array
-		for (int j = 0; j < N; j++) {
-			printf("%i", array[i][j]); // Print array element
-			printf(" ");
-		}
-		printf("]\n"); // Print closing bracket for inner array and move to next line
-	}
-	printf("]\n\n"); // Print closing bracket for array and move to next line
-}		//prints array to console
-
-void openclMatrixMultiplication(int np, int rank, int inputArray1[N][N], int inputArray2[N][N], int outputArray[N][N]){
-    long value;
-    int range = N/np;
-	int start = rank * range;
-	int end = start + range;
-    int buffArray[range][N]={0};
-  
-    clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, &event);
-    clWaitForEvents(1, &event);
-
-    //copying data from the device back to host c matrix
-    clEnqueueReadBuffer(queue, bufC, CL_TRUE, 0, N * N*sizeof(int), c, 0, NULL, NULL);
-    //print_matrix(c)
-   
-    free_memory();
+void openclMatrixMultiplication(int np, int rank, const Matrix &inputArray1, const Matrix &inputArray2, Matrix &outputArray, PhaseTimes *times){
+    int start, end;
+    partitionRows(N, np, rank, start, end); // Determine the balanced range of rows the current process will handle
+    Matrix stripArray = createMatrix(end - start, N); // Only this rank's rows of inputArray1
+    Matrix buffArray = createMatrix(end - start, N); // This rank's rows of the result, read back from the device
+
+    double phase = MPI_Wtime();
+    scatterRows(MPI_COMM_WORLD, N, inputArray1, stripArray); // Root sends each rank its own rows, remainder rows included
+    if (stripArray.rows > 0) {
+        check(clEnqueueWriteBuffer(queue, bufA, CL_FALSE, 0, stripArray.size() * sizeof(int), stripArray.data, 0, NULL, NULL), "writing A");
+        check(clEnqueueWriteBuffer(queue, bufB, CL_TRUE, 0, inputArray2.size() * sizeof(int), inputArray2.data, 0, NULL, NULL), "writing B");
+    }
+    addPhase(times, PHASE_DISTRIBUTE, phase, rank != 0 ? (double)stripArray.size() * sizeof(int) : 0);
+
+    phase = MPI_Wtime();
+    if (stripArray.rows > 0) {
+        cl_event event;
+        check(clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, &event), "enqueueing the kernel");
+        check(clWaitForEvents(1, &event), "running the kernel");
+        clReleaseEvent(event);
+    }
+    addPhase(times, PHASE_COMPUTE, phase);
+
+    phase = MPI_Wtime();
+    if (stripArray.rows > 0) {
+        check(clEnqueueReadBuffer(queue, bufC, CL_TRUE, 0, buffArray.size() * sizeof(int), buffArray.data, 0, NULL, NULL), "reading C"); // The strip the kernel wrote, not a zeroed buffer
+    }
+    gatherRows(MPI_COMM_WORLD, N, buffArray, outputArray); // Gather results from all processes
+    addPhase(times, PHASE_COLLECT, phase, rank != 0 ? (double)buffArray.size() * sizeof(int) : 0);
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Gather(buffArray, range * N, MPI_INT, outputArray, range * N, MPI_INT, 0, MPI_COMM_WORLD);
+    freeMatrix(stripArray);
+    freeMatrix(buffArray);
 }
 
-void free_memory() {
-   
-   clReleaseKernel(kernel);
-   clReleaseMemObject(bufA);
-    clReleaseMemObject(bufB);
-    clReleaseMemObject(bufC);
-
-   clReleaseCommandQueue(queue);
-   clReleaseProgram(program);
-   clReleaseContext(context);
+void check(cl_int err, const char *what) {
+    if (err == CL_SUCCESS) return;
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    fprintf(stderr, "rank %d: OpenCL error %d %s\n", rank, err, what);
+    MPI_Abort(MPI_COMM_WORLD, 1);
 }
-void copy_kernel_args() {
-   clSetKernelArg(kernel, 0, sizeof(int), (void*)&max);
-    clSetKernelArg(kernel, 1, sizeof(int), (void*)&max);
-    clSetKernelArg(kernel, 2, sizeof(int), (void*)&max);
-    clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&bufA);
-    clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&bufB);
-    clSetKernelArg(kernel, 5, sizeof(cl_mem), (void*)&bufC);
-    if(err < 0) {
-      perror("Couldn't create a kernel argument");
-      printf("error = %d", err);
-      exit(1);
-   }
+
+void free_memory() {
+    if (bufA) clReleaseMemObject(bufA);
+    if (bufB) clReleaseMemObject(bufB);
+    if (bufC) clReleaseMemObject(bufC);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+    clReleaseProgram(program);
+    clReleaseContext(context);
 }
-void setup_kernel_memory() {
-     bufA = clCreateBuffer(context, CL_MEM_READ_ONLY,  N*N*sizeof(int), NULL, NULL);
-     bufB = clCreateBuffer(context, CL_MEM_READ_ONLY,  N*N*sizeof(int), NULL, NULL);
-     bufC = clCreateBuffer(context, CL_MEM_READ_WRITE, N*N*sizeof(int), NULL, NULL);
 
-    // Copy matrices to the GPU
-    clEnqueueWriteBuffer(queue, bufA, CL_TRUE, 0, N*N*sizeof(int), a, 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, bufB, CL_TRUE, 0, N*N*sizeof(int), b, 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, bufC, CL_TRUE, 0, N*N*sizeof(int), c, 0, NULL, NULL);
+void copy_kernel_args(int rows) {
+    int stride = matrixStride<int>(N); // A strip, B and the C strip all have N columns
+    check(clSetKernelArg(kernel, 0, sizeof(int), &rows), "setting M");
+    check(clSetKernelArg(kernel, 1, sizeof(int), &N), "setting N");
+    check(clSetKernelArg(kernel, 2, sizeof(int), &N), "setting K");
+    check(clSetKernelArg(kernel, 3, sizeof(int), &stride), "setting lda");
+    check(clSetKernelArg(kernel, 4, sizeof(int), &stride), "setting ldb");
+    check(clSetKernelArg(kernel, 5, sizeof(int), &stride), "setting ldc");
+    check(clSetKernelArg(kernel, 6, sizeof(cl_mem), &bufA), "setting A");
+    check(clSetKernelArg(kernel, 7, sizeof(cl_mem), &bufB), "setting B");
+    check(clSetKernelArg(kernel, 8, sizeof(cl_mem), &bufC), "setting C");
+
+    local[0] = local[1] = TS;
+    global[0] = (size_t)(N + TS - 1) / TS * TS; // Whole work groups, the kernel skips the items past the edge
+    global[1] = (size_t)(rows + TS - 1) / TS * TS;
+}
 
+void setup_kernel_memory(int rows) {
+    bufA = bufB = bufC = NULL;
+    if (rows == 0) return; // More ranks than rows, nothing to run on this one
+    size_t strip = (size_t)rows * matrixStride<int>(N) * sizeof(int), full = (size_t)N * matrixStride<int>(N) * sizeof(int);
+    cl_int err;
+    bufA = clCreateBuffer(context, CL_MEM_READ_ONLY, strip, NULL, &err);
+    check(err, "creating the A buffer");
+    bufB = clCreateBuffer(context, CL_MEM_READ_ONLY, full, NULL, &err);
+    check(err, "creating the B buffer");
+    bufC = clCreateBuffer(context, CL_MEM_WRITE_ONLY, strip, NULL, &err);
+    check(err, "creating the C buffer");
 }
 
-void setup_openCL_device_context_queue_kernel() {
-    device_id = create_device();
+void setup_openCL_device_context_queue_kernel(const char *type) {
+    device_id = create_device(type);
     cl_int err;
     context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &err);
-   if(err < 0) {
-      perror("Couldn't create a context");
-      exit(1);   
-   }
+    check(err, "creating a context");
 
-     program = build_program(context, device_id, "matrix_mul.cl");
+    size_t maxGroup = 0;
+    clGetDeviceInfo(device_id, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxGroup), &maxGroup, NULL);
+    if (TS < 1) TS = DEFAULT_TS;
+    while (TS > 1 && (size_t)TS * TS > maxGroup) TS /= 2; // TS x TS work items have to fit in one work group
 
-   
+    char options[64];
+    snprintf(options, sizeof(options), "-DTS=%d", TS);
+    program = build_program(context, device_id, kernelSource, options);
 
-      queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
-    if(err < 0) {
-      perror("Couldn't create a command queue");
-      exit(1);   
-    };
+    queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
+    check(err, "creating a command queue");
 
     kernel = clCreateKernel(program, "multiply_matrices", &err);
-   if(err < 0) {
-      perror("Couldn't create a kernel");
-      printf("error =%d", err);
-      exit(1);
-   };
-
-}
-cl_program build_program(cl_context ctx, cl_device_id dev, const char* filename) {
-
-   cl_program program;
-   FILE *program_handle;
-   char *program_buffer, *program_log;
-   size_t program_size, log_size;
-  
-
-   /* Read program file and place content into buffer */
-   program_handle = fopen(filename, "r");
-   if(program_handle == NULL) {
-      perror("Couldn't find the program file");
-      exit(1);
-   }
-   fseek(program_handle, 0, SEEK_END);
-   program_size = ftell(program_handle);
-   rewind(program_handle);
-   program_buffer = (char*)malloc(program_size + 1);
-   program_buffer[program_size] = '\0';
-   fread(program_buffer, sizeof(char), program_size, program_handle);
-   fclose(program_handle);
-
-   /* Create program from file 
-
-   Creates a program from the source code in the add_numbers.cl file. 
-   Specifically, the code reads the file's content into a char array 
-   called program_buffer, and then calls clCreateProgramWithSource.
-   */
-   program = clCreateProgramWithSource(ctx, 1, 
-      (const char**)&program_buffer, &program_size, &err);
-   if(err < 0) {
-      perror("Couldn't create the program");
-      exit(1);
-   }
-   free(program_buffer);
-
-   /* Build program 
-
-   The fourth parameter accepts options that configure the compilation. 
-   These are similar to the flags used by gcc. For example, you can 
-   define a macro with the option -DMACRO=VALUE and turn off optimization 
-   with -cl-opt-disable.
-   */
-   err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-   if(err < 0) {
-
-      /* Find size of log and print to std output */
-      clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 
-            0, NULL, &log_size);
-      program_log = (char*) malloc(log_size + 1);
-      program_log[log_size] = '\0';
-      clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 
-            log_size + 1, program_log, NULL);
-      printf("%s\n", program_log);
-      free(program_log);
-      exit(1);
-   }
-
-   return program;
-}
-
-    cl_device_id create_device() {
-
-    cl_platform_id platform;
-    cl_device_id dev;
-    int err;
-
-    /* Identify a platform */
-    err = clGetPlatformIDs(1, &platform, NULL);
-    if(err < 0) {
-       perror("Couldn't identify a platform");
-       exit(1);
-    } 
-
-   // Access a device
-   // GPU
-   err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &dev, NULL);
-   if(err == CL_DEVICE_NOT_FOUND) {
-      // CPU
-      err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &dev, NULL);
-   }
-   if(err < 0) {
-      perror("Couldn't access any devices");
-      exit(1);   
-   }
-
-   return dev;
+    check(err, "creating the kernel");
 }
 
-
-void init (int a[N][N]) {
-    for(int i=0; i < N; i++) {
-        int add = 0;
-       for(int j=0; j < N; j++) {
-           a[i][j] = rand() % 10 ;//+ add;
-           add += 10;
-        } 
+cl_program build_program(cl_context ctx, cl_device_id dev, const char *source, const char *options) {
+    cl_int err;
+    cl_program program = buildCachedProgram(ctx, dev, source, options, &err, &programCached); // Compiles only on a cache miss
+    if (program == NULL) check(err, "creating the program");
+    if (err != CL_SUCCESS) {
+        size_t log_size;
+        clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size); // Print the compiler's log before giving up
+        char *program_log = (char*)malloc(log_size + 1);
+        program_log[log_size] = '\0';
+        clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
+        fprintf(stderr, "%s\n", program_log);
+        free(program_log);
+        check(err, "building the program");
     }
-}
 
-void matrix_mul(int a[N][N], int b[N][N], int c[N][N]) {
-    for(int i=0; i < N; i++) {
-       
-       for(int j=0; j < N; j++) {
-            int val = 0;
-           for(int k=0; k < N; k++) {
-            val += a[i][k] * b[k][j]; 
-            }
-            c[i][j] = val; 
-        } 
-    }
+    return program;
 }
 
-void print_matrix(int a[N][N]) 
-{
-    for(int i=0; i < N; i++) {
-       for(int j=0; j < N; j++) {
-           printf("%d ", a[i][j]);
-        } 
-        printf("\n");
+cl_device_id create_device(const char *type) {
+    cl_uint platforms = 0;
+    check(clGetPlatformIDs(0, NULL, &platforms), "counting platforms");
+    vector<cl_platform_id> ids(platforms);
+    check(clGetPlatformIDs(platforms, ids.data(), NULL), "identifying a platform");
+
+    cl_device_type wanted[2] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU }; // A GPU first, CPU OpenCL such as POCL otherwise
+    if (strcmp(type, "cpu") == 0) wanted[0] = CL_DEVICE_TYPE_CPU;
+    if (strcmp(type, "gpu") == 0) wanted[1] = CL_DEVICE_TYPE_GPU;
+    for (int w = 0; w < 2; w++) {
+        for (cl_uint p = 0; p < platforms; p++) { // The CPU runtime is not always the first platform
+            cl_device_id dev;
+            if (clGetDeviceIDs(ids[p], wanted[w], 1, &dev, NULL) == CL_SUCCESS) return dev;
+        }
     }
+    check(CL_DEVICE_NOT_FOUND, "finding a device");
+    return NULL;
 }
@@ -7,137 +7,69 @@
 
 // To run:
 // $ mpirun -np 4 --hostfile ~/Desktop/Slave.list
+// $ mpirun -np 4 ./a.out 2000 --warmup=1 --reps=5 --baseline=1 --verify=10 --verify-seed=42 --format=csv --phases=scaling.csv
+// $ mpirun -np 9 ./a.out 3000                      (Cannon on a 3 x 3 grid, picked when np is a perfect square)
+// $ mpirun -np 9 ./a.out 2                         (Cannon with N < q, ranks with empty blocks shift zero padding)
+// $ mpirun -np 6 ./a.out 3000 --algorithm=summa    (2D blocks on a 2 x 3 grid, picked otherwise)
+// $ mpirun -np 6 ./a.out 2 --algorithm=summa       (N < grid size, ranks with empty blocks still take part)
+// $ mpirun -np 6 ./a.out 3000 --algorithm=rows     (row strips of A scattered, B broadcast once per node into shared memory, --shared=0 for a copy per rank)
+// $ mpirun -np 6 ./a.out 4000 --algorithm=pipeline --panel=512   (row strips, B broadcast in column panels overlapped with the multiply, also once per node unless --shared=0)
 // $ mpirun -np 4 ./a.out
+// $ mpirun --map-by ppr:1:socket --bind-to socket -np 2 ./a.out 4000 --algorithm=pipeline --pin=compact   (one rank per socket, a team on each socket's cores)
+// $ mpirun --map-by ppr:4:node -np 8 ./a.out 4000 --threads=4                                            (ranks per node from the mapping, threads per rank from --threads)
+
+// Hybrid: MPI is started with MPI_THREAD_FUNNELED and only the master thread of each rank ever calls MPI,
+// always outside the OpenMP parallel regions. The team multiplies the rank's strip or block in cache
+// blocked tiles (openmpBlockedMatrixMultiply), and in the pipelined mode the master polls the
+// outstanding transfers between chunks of the strip. Threads per rank default to the CPUs the rank is
+// bound to, or to an even share of the node's CPUs when mpirun did not bind it.
 
 #include<mpi.h>
-#include<stdlib.h>
-#include<unistd.h>
 #include<stdio.h>
-#include<sys/time.h>
-#include<time.h>
+#include<unistd.h>
+#include "../../Module 2/gemm.h"
+#include "../../Module 2/affinity.h"
+#include "mpiMultiply.h"
 #include<omp.h>
 
-#define N 800 // Define the size of the matrices
+#define DEFAULT_N 800 // Default size of the matrices, override with the first argument
 
 using namespace std;
 
-void intialiseArray(int array[N][N]); // Function to initialize the array with random values
-void printArrays(int array[N][N]); // Function to print arrays to the console
-void openmpMatrixMultiplication(int np, int rank, int inputArray1[N][N], int inputArray2[N][N], int outputArray[N][N]); // Function to perform matrix multiplication
-//void MatrixMultiplication(int np, int rank, int inputArray1[N][N], int inputArray2[N][N], int outputArray[N*N]);
-struct timeval timecheck;
-
-void printOutput(int outputArray[N]){
-    for (int i = 0 ; i < N; i++){
-        printf(" %d :", outputArray[i]);
-    }
-    
-}
-
-
-int main(){
-    MPI_Init(NULL, NULL);
+void localMultiply(const Matrix &A, const Matrix &B, Matrix &C, bool accumulate); // Multiply of the blocks held by this rank
 
-    int np = 0;
-    MPI_Comm_size(MPI_COMM_WORLD, &np);     // Get the number of nodes
+int main(int argc, char *argv[]){
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); // Threads exist, but only the master calls MPI
 
     int rank = 0;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);    // Get the rank of the current process
+    if (rank == 0 && provided < MPI_THREAD_FUNNELED) fprintf(stderr, "warning: MPI only provides thread level %d, MPI calls stay on the master thread outside parallel regions\n", provided);
 
-    int inputArray1[N][N], inputArray2[N][N]; // Declare input arrays
-    int outputArray[N][N]={{0}}; // Declare output array
-    //int outputArray[N*N]={0};
-
-    if (rank==0) { // If it is the root process
-        intialiseArray(inputArray1); // Initialize inputArray1
-        intialiseArray(inputArray2); // Initialize inputArray2
-
-        //printArrays(inputArray1);
-        //printArrays(inputArray2);
-    }else{
-        //printArrays(outputArray);
-    }
-
-    //Timer Start
-    if (rank == 0){
-        printf("OpenMP MPI Matrix Multiplication.\n");
-    }
-
-    gettimeofday(&timecheck, NULL);
-	long timeofday_start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
-
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Bcast(&inputArray1, N*N, MPI_INT, 0, MPI_COMM_WORLD); // Broadcast inputArray1 to all processes
-    MPI_Bcast(&inputArray2, N*N, MPI_INT, 0, MPI_COMM_WORLD); // Broadcast inputArray2 to all processes
-
-    MPI_Barrier(MPI_COMM_WORLD);
-    openmpMatrixMultiplication(np, rank, inputArray1, inputArray2, outputArray); // Perform matrix multiplication
-    MPI_Barrier(MPI_COMM_WORLD);
-    
-    //if(rank==0)printArrays(outputArray);
-    
-    MPI_Finalize(); // Finalize MPI
+    NodeComms nodes = createNodeComms(MPI_COMM_WORLD); // Ranks that share this node's CPUs
+    int ranksPerNode = nodes.nodeSize;
+    freeNodeComms(nodes);
+
+    int cpus = omp_get_num_procs(); // CPUs in this rank's affinity mask
+    bool bound = cpus < sysconf(_SC_NPROCESSORS_ONLN); // mpirun bound the rank to a socket or core set
+    int threads = parseOption(argc, argv, "--threads", bound || cpus < ranksPerNode ? cpus : cpus / ranksPerNode); // Threads per rank
+    if (threads < 1) threads = 1;
+    omp_set_num_threads(threads); // One team per rank
+
+    PinMode pin = parsePinMode(argc, argv, PIN_NONE);
+    int pinned = pinOpenmpThreads(pinOrder(pin)), allPinned = 0; // Within the CPUs mpirun gave this rank
+    MPI_Reduce(&pinned, &allPinned, 1, MPI_INT, MPI_LAND, 0, MPI_COMM_WORLD);
 
-    //Timer end
-    gettimeofday(&timecheck, NULL);
-	long timeofday_end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /1000;
-	double time_elapsed = timeofday_end - timeofday_start;
-	
-    if (rank == 0){
-        printf("\t\tTime elapsed: %f ms\n", time_elapsed); // Print the time elapsed for the operation
-    }
+    char detail[96];
+    snprintf(detail, sizeof(detail), ", %d ranks per node, %d threads per rank", ranksPerNode, threads);
+    MultiplyProgram program = { "OpenMP MPI Matrix Multiplication", "mpi+openmp", DEFAULT_N, localMultiply, threads, pinModeName(allPinned ? pin : PIN_NONE), detail };
+    runMultiplyProgram(argc, argv, program); // Options, repetitions, verification and the report (mpiMultiply.h)
+
+    MPI_Finalize(); // Finalize MPI
 
     return 0;
 }
 
-void intialiseArray(int array[N][N]) {
-	printf("intialising array... "); // Print message indicating initialization of the array
-	for (int i = 0; i < N; i++)
-	{
-		for (int j = 0; j < N; j++)
-		{
-			array[i][j] = rand() % ((10 - 1) + 1) + 1; // Assign random values to the array elements
-		}
-	}
-	printf("complete\n"); // Print message indicating completion of initialization
-}		//intialises array with random values, uses the N global variable
-
-void printArrays(int array[N][N]){
-	printf("["); // Print opening bracket for array
-	for (int i = 0; i < N; i++) {
-		printf("["); // Print opening bracket for inner array
-		for (int j = 0; j < N; j++) {
-			printf("%i", array[i][j]); // Print array element
-			printf(" ");
-		}
-		printf("]\n"); // Print closing bracket for inner array and move to next line
-	}
-	printf("]\n\n"); // Print closing bracket for array and move to next line
-}		//prints array to console
-
-void openmpMatrixMultiplication(int np, int rank, int inputArray1[N][N], int inputArray2[N][N], int outputArray[N][N]){
-    long value;
-    int range = N/np; // Determine the range of rows each process will handle
-	int start = rank * range; // Determine the starting row for the current process
-	int end = start + range; // Determine the ending row for the current process
-    int buffArray[range][N]={0}; // Declare a buffer array to store intermediate results
-  
-#pragma omp parallel // Start OpenMP parallel region
-{  
-    #pragma omp for // Distribute loop iterations among OpenMP threads
-    for (int i = start ; i < end ; i++) // Iterate over rows assigned to the current process
-	{
-		for (int j = 0; j < N; j++) // Iterate over columns
-		{
-			value = 0;
-			for (int k = 0; k < N; k++) // Iterate over elements in the row and column
-			{
-				value += inputArray1[i][k] * inputArray2[k][j]; // Perform matrix multiplication
-			}
-            buffArray[i - start][j]=value; // Store the result in the buffer array
-		}
-	}
-}
-    MPI_Barrier(MPI_COMM_WORLD); // Synchronize all processes
-    MPI_Gather(buffArray, range * N, MPI_INT, outputArray, range * N, MPI_INT, 0, MPI_COMM_WORLD); // Gather results from all processes
+void localMultiply(const Matrix &A, const Matrix &B, Matrix &C, bool accumulate){
+    openmpBlockedMatrixMultiply(A, B, C, defaultBlockSizes(), accumulate); // Blocked SIMD kernel across this rank's OpenMP threads
 }
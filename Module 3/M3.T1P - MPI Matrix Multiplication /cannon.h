@@ -0,0 +1,76 @@
+// cannon.h
+//
+// Cannon's algorithm on a square q x q process grid, C = A * B.
+// Every rank holds exactly one block of A, B and C for the whole multiply. After an initial skew
+// (block row i of A shifted i places left, block column j of B shifted j places up) rank (i, j) holds
+// A(i, i + j) and B(i + j, j); it multiplies them, then passes A one place left and B one place up
+// with MPI_Sendrecv_replace, q times in all. Every message goes to a grid neighbour (with wrap
+// around), which maps well onto torus and ring networks, and no rank ever holds more than three blocks.
+//
+// Blocks are the balanced processGrid.h blocks zero padded to a common b x b, b = ceil(N / q), so
+// uneven N works: on a square grid the k range of A's columns and B's rows is the same partition, so
+// the padding columns of an A block always meet padding rows of the B block and add nothing.
+// With N < q some ranks' real blocks are empty (scatterBlocks sends them 0 ints) but the padded
+// b x b block is never empty, so every rank still shifts and multiplies on the same schedule.
+
+#ifndef CANNON_H
+#define CANNON_H
+
+#include "processGrid.h"
+#include "summa.h"
+
+inline bool isPerfectSquare(int np){
+    int q = (int)sqrt((double)np);
+    while (q * q > np) q--;
+    while ((q + 1) * (q + 1) <= np) q++;
+    return q * q == np;
+}
+
+inline int cannonBlockSize(const ProcessGrid &g, int n){
+    return (n + g.rows - 1) / g.rows;
+}
+
+inline Matrix createCannonBlock(const ProcessGrid &g, int n){
+    int b = cannonBlockSize(g, n);
+    Matrix m = createMatrix(b, b);
+    zeroMatrix(m); // Padding has to be zero, it is shifted around with the data
+    return m;
+}
+
+inline Matrix cannonView(const ProcessGrid &g, int n, const Matrix &block){
+    int rowStart, rowEnd, colStart, colEnd;
+    gridBlock(g, n, g.row, g.col, rowStart, rowEnd, colStart, colEnd);
+    return subMatrix(block, 0, 0, rowEnd - rowStart, colEnd - colStart);
+}       //the part of a padded block that holds this rank's real grid block
+
+inline void shiftBlock(Matrix &block, int distance, MPI_Comm ring, PhaseTimes *times = NULL){
+    int size, position;
+    MPI_Comm_size(ring, &size);
+    MPI_Comm_rank(ring, &position);
+    distance %= size;
+    if (distance == 0) return;
+    double start = MPI_Wtime();
+    int dest = (position - distance + size) % size; // Towards the front of the ring (left or up)
+    int source = (position + distance) % size;
+    MPI_Datatype type = blockType(block);
+    MPI_Sendrecv_replace(block.data, blockCount(block), type, dest, 0, source, 0, ring, MPI_STATUS_IGNORE);
+    freeBlockType(type);
+    addPhase(times, PHASE_DISTRIBUTE, start, (double)block.rows * block.cols * sizeof(int));
+}       //cyclic shift of one block by distance places, in place
+
+inline void cannonMultiply(const ProcessGrid &g, Matrix &blockA, Matrix &blockB, Matrix &blockC, LocalMultiply multiply, PhaseTimes *times = NULL){
+    shiftBlock(blockA, g.row, g.rowComm, times); // Skew: row i of A moves i places left
+    shiftBlock(blockB, g.col, g.colComm, times); // Skew: column j of B moves j places up
+
+    for (int step = 0; step < g.rows; step++) {
+        double start = MPI_Wtime();
+        multiply(blockA, blockB, blockC, step > 0); // First step overwrites C, the rest add to it
+        addPhase(times, PHASE_COMPUTE, start);
+        if (step + 1 < g.rows) {
+            shiftBlock(blockA, 1, g.rowComm, times); // A one place left
+            shiftBlock(blockB, 1, g.colComm, times); // B one place up
+        }
+    }
+}       //blockC = block (row, col) of A * B, A and B are left skewed, blocks must come from createCannonBlock
+
+#endif
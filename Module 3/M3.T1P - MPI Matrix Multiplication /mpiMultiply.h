@@ -0,0 +1,296 @@
+// mpiMultiply.h
+//
+// The distributed multiplies shared by MPI.cpp, OpenMpMPI.cpp and OpenCLMPI.cpp, C = A * B with A, B
+// and C n x n and only the root holding the full A and C.
+// Row strips: rank r owns rows partitionRows(n, np, r) of A and C, remainder rows included, and
+// scatterRows / gatherRows move the uneven strips between the root's full matrix and every rank with
+// one MPI_Scatterv / MPI_Gatherv. rowsMatrixMultiplication, summaMatrixMultiplication and
+// cannonMatrixMultiplication run one whole multiply with the LocalMultiply the program passes in, so
+// the programs only differ in how a rank multiplies its own strip or block.
+// chooseAlgorithm reads --algorithm: cannon when np is a perfect square, summa otherwise, or rows and
+// pipeline when asked for. Cannon on a non-square np falls back to SUMMA.
+//
+// runMultiplyProgram is the whole benchmark driver behind MPI.cpp and OpenMpMPI.cpp: options, the
+// shared copy of B, the timed repetitions, the per-phase report, the Freivalds check and the summary.
+// A program sets up MPI and its threads, then passes its MultiplyProgram in.
+
+#ifndef MPI_MULTIPLY_H
+#define MPI_MULTIPLY_H
+
+#include <mpi.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "../../Module 2/matrix.h"
+#include "../../Module 2/gemm.h"
+#include "../../Module 2/benchmark.h"
+#include "../../Module 2/verify.h"
+#include "processGrid.h"
+#include "summa.h"
+#include "cannon.h"
+#include "pipeline.h"
+#include "phases.h"
+#include "nodeShared.h"
+
+struct MultiplyProgram {
+    const char *title; // First word of the banner on stderr
+    const char *variant; // Reported as variant-algorithm
+    int defaultN; // Matrix size when the first argument is missing
+    LocalMultiply multiply; // How a rank multiplies its own strip or block
+    int threads; // Threads per rank, the report counts ranks * threads workers
+    const char *pinning; // Reported pinning, NULL for none
+    const char *detail; // Appended to the banner, such as the threads per rank
+};
+
+inline void rowCounts(int n, int np, int stride, int *counts, int *displs){
+    for (int r = 0; r < np; r++) { // Rank r owns rows start..end, remainder rows included
+        int start, end;
+        partitionRows(n, np, r, start, end);
+        counts[r] = (end - start) * stride;
+        displs[r] = start * stride;
+    }
+}
+
+inline void scatterRows(MPI_Comm comm, int n, const Matrix &inputArray, Matrix &stripArray){
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+    int *counts = NULL, *displs = NULL;
+    if (rank == 0) {
+        counts = (int*)malloc(np * sizeof(int));
+        displs = (int*)malloc(np * sizeof(int));
+        rowCounts(n, np, stripArray.stride, counts, displs);
+    }
+    MPI_Scatterv(inputArray.data, counts, displs, MPI_INT, stripArray.data, stripArray.size(), MPI_INT, 0, comm);
+    free(counts);
+    free(displs);
+}       //stripArray is this rank's rows x n, inputArray is only read on the root
+
+inline void gatherRows(MPI_Comm comm, int n, const Matrix &buffArray, Matrix &outputArray){
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+    int *counts = NULL, *displs = NULL;
+    if (rank == 0) {
+        counts = (int*)malloc(np * sizeof(int));
+        displs = (int*)malloc(np * sizeof(int));
+        rowCounts(n, np, buffArray.stride, counts, displs);
+    }
+    MPI_Gatherv(buffArray.data, buffArray.size(), MPI_INT, outputArray.data, counts, displs, MPI_INT, 0, comm);
+    free(counts);
+    free(displs);
+}       //outputArray is only written on the root
+
+inline void rowsMatrixMultiplication(MPI_Comm comm, int n, const Matrix &inputArray1, const Matrix &inputArray2, Matrix &outputArray, LocalMultiply multiply, PhaseTimes *times = NULL){
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+    int start, end;
+    partitionRows(n, np, rank, start, end); // Determine the balanced range of rows the current process will handle
+    Matrix stripArray = createMatrix(end - start, n); // Only this rank's rows of inputArray1
+    Matrix buffArray = createMatrix(end - start, n); // Declare a buffer array to store intermediate results
+
+    double phase = MPI_Wtime();
+    scatterRows(comm, n, inputArray1, stripArray); // Root sends each rank its own rows, remainder rows included
+    addPhase(times, PHASE_DISTRIBUTE, phase, rank != 0 ? (double)stripArray.size() * sizeof(int) : 0);
+
+    phase = MPI_Wtime();
+    multiply(stripArray, inputArray2, buffArray, false); // Multiply the local strip
+    addPhase(times, PHASE_COMPUTE, phase);
+
+    phase = MPI_Wtime();
+    gatherRows(comm, n, buffArray, outputArray); // Gather results from all processes
+    addPhase(times, PHASE_COLLECT, phase, rank != 0 ? (double)buffArray.size() * sizeof(int) : 0);
+    freeMatrix(stripArray);
+    freeMatrix(buffArray);
+}       //inputArray2 must already be whole on every rank
+
+inline void summaMatrixMultiplication(const ProcessGrid &grid, int n, const Matrix &inputArray1, const Matrix &inputArray2, Matrix &outputArray, LocalMultiply multiply, PhaseTimes *times = NULL){
+    Matrix localA = createLocalBlock(grid, n); // Each rank holds one block of A, B and C
+    Matrix localB = createLocalBlock(grid, n);
+    Matrix localC = createLocalBlock(grid, n);
+
+    double phase = MPI_Wtime(), block = grid.rank != 0 ? (double)localC.rows * localC.cols * sizeof(int) : 0;
+    scatterBlocks(grid, n, inputArray1, localA, 0); // Root hands out the blocks of A and B
+    scatterBlocks(grid, n, inputArray2, localB, 0);
+    addPhase(times, PHASE_DISTRIBUTE, phase, 2 * block);
+    summaMultiply(grid, n, localA, localB, localC, defaultBlockSizes().kc, multiply, times); // Panels of A go along grid rows, panels of B down grid columns
+    phase = MPI_Wtime();
+    gatherBlocks(grid, n, localC, outputArray, 0); // Collect the blocks of C on the root
+    addPhase(times, PHASE_COLLECT, phase, block);
+
+    freeMatrix(localA);
+    freeMatrix(localB);
+    freeMatrix(localC);
+}
+
+inline void cannonMatrixMultiplication(const ProcessGrid &grid, int n, const Matrix &inputArray1, const Matrix &inputArray2, Matrix &outputArray, LocalMultiply multiply, PhaseTimes *times = NULL){
+    Matrix blockA = createCannonBlock(grid, n); // Three zero padded blocks per rank, nothing else
+    Matrix blockB = createCannonBlock(grid, n);
+    Matrix blockC = createCannonBlock(grid, n);
+
+    Matrix viewA = cannonView(grid, n, blockA), viewB = cannonView(grid, n, blockB), viewC = cannonView(grid, n, blockC);
+    double phase = MPI_Wtime(), block = grid.rank != 0 ? (double)viewC.rows * viewC.cols * sizeof(int) : 0;
+    scatterBlocks(grid, n, inputArray1, viewA, 0); // Root hands out the blocks of A and B
+    scatterBlocks(grid, n, inputArray2, viewB, 0);
+    addPhase(times, PHASE_DISTRIBUTE, phase, 2 * block);
+    cannonMultiply(grid, blockA, blockB, blockC, multiply, times); // Nearest neighbour shifts only
+    phase = MPI_Wtime();
+    gatherBlocks(grid, n, viewC, outputArray, 0); // Collect the blocks of C on the root
+    addPhase(times, PHASE_COLLECT, phase, block);
+
+    freeMatrix(blockA);
+    freeMatrix(blockB);
+    freeMatrix(blockC);
+}       //any n, ranks whose blocks are empty when n < q shift zero padding
+
+inline const char *chooseAlgorithm(int argc, char *argv[], int np){
+    const char *algorithm = parseString(argc, argv, "--algorithm", "auto"); // cannon, summa, rows (scatter A, broadcast B) or pipeline (rows with non-blocking panels)
+    if (strcmp(algorithm, "auto") == 0 || (strcmp(algorithm, "cannon") == 0 && !isPerfectSquare(np))) {
+        algorithm = isPerfectSquare(np) ? "cannon" : "summa"; // Cannon needs a square grid, SUMMA takes any shape
+    }
+    return algorithm;
+}
+
+inline void intialiseArray(Matrix &array) {
+    fprintf(stderr, "intialising array... "); // Print message indicating initialization of the array
+    for (int i = 0; i < array.rows; i++)
+    {
+        for (int j = 0; j < array.cols; j++)
+        {
+            array[i][j] = rand() % ((10 - 1) + 1) + 1; // Assign random values to the array elements
+        }
+    }
+    fprintf(stderr, "complete\n"); // Print message indicating completion of initialization
+}       //intialises array with random values
+
+inline void printArrays(const Matrix &array){
+    printf("["); // Print opening bracket for array
+    for (int i = 0; i < array.rows; i++) {
+        printf("["); // Print opening bracket for inner array
+        for (int j = 0; j < array.cols; j++) {
+            printf("%i", array[i][j]); // Print array element
+            printf(" ");
+        }
+        printf("]\n"); // Print closing bracket for inner array and move to next line
+    }
+    printf("]\n\n"); // Print closing bracket for array and move to next line
+}       //prints array to console
+
+inline void runMultiplyProgram(int argc, char *argv[], const MultiplyProgram &program){
+    int N = parseSize(argc, argv, 1, program.defaultN); // Read the matrix size from argv
+
+    int np = 0;
+    MPI_Comm_size(MPI_COMM_WORLD, &np);     // Get the number of nodes
+
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);    // Get the rank of the current process
+
+    const char *algorithm = chooseAlgorithm(argc, argv, np); // cannon, summa, rows (scatter A, broadcast B) or pipeline (rows with non-blocking panels)
+    bool rows = strcmp(algorithm, "rows") == 0;
+    bool pipeline = strcmp(algorithm, "pipeline") == 0;
+    ProcessGrid grid = createProcessGrid(MPI_COMM_WORLD);
+
+    NodeComms nodes = createNodeComms(MPI_COMM_WORLD); // Ranks that share this node's memory
+    bool share = (rows || pipeline) && parseOption(argc, argv, "--shared", 1) != 0; // One copy of inputArray2 per node in the row strip modes
+    SharedMatrix sharedArray2;
+
+    Matrix inputArray1 = createMatrix(rank == 0 ? N : 0, N); // Declare input arrays on the heap, other ranks only hold their rows or blocks
+    Matrix inputArray2;
+    if (share) {
+        sharedArray2 = createSharedMatrix(nodes, N, N); // Node leaders hold it, the rest of the node maps the leader's copy
+        inputArray2 = sharedArray2.m;
+    } else {
+        inputArray2 = createMatrix(rank == 0 || rows || pipeline ? N : 0, N);
+    }
+    Matrix outputArray = createMatrix(rank == 0 ? N : 0, N); // Only the root collects the full output
+    zeroMatrix(outputArray);
+
+    if (rank==0) { // If it is the root process
+        intialiseArray(inputArray1); // Initialize inputArray1
+        intialiseArray(inputArray2); // Initialize inputArray2
+
+        //printArrays(inputArray1);
+        //printArrays(inputArray2);
+    }
+
+    int warmup = parseOption(argc, argv, "--warmup", 0); // Untimed repetitions
+    int reps = parseOption(argc, argv, "--reps", 1); // Timed repetitions
+    bool baseline = parseOption(argc, argv, "--baseline", 0) != 0; // Also time a single process multiply on the root
+    const char *format = parseString(argc, argv, "--format", "csv");
+    int rounds = parseOption(argc, argv, "--verify", VERIFY_DEFAULT_ROUNDS); // Freivalds rounds on the gathered result, 0 to skip
+    unsigned seed = verifySeed(argc, argv); // Only the root verifies, --verify-seed= repeats its vectors
+    int panel = parseOption(argc, argv, "--panel", PIPELINE_PANEL); // Columns of B per broadcast in the pipelined mode
+    const char *phasesPath = parseString(argc, argv, "--phases", NULL); // Append the per-phase report here, stderr when not given
+
+    if (rank == 0){
+        fprintf(stderr, "%s (%s, %d x %d grid%s).\n", program.title, algorithm, grid.rows, grid.cols, program.detail ? program.detail : "");
+        if (share) fprintf(stderr, "inputArray2 held once per node in shared memory, %d nodes.\n", nodes.nodes);
+        if (rounds > 0) fprintf(stderr, "verify seed %u.\n", seed);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(reps); // One per timed repetition
+    PhaseTimes phases = createPhaseTimes(); // This rank's distribute, compute, collect and verify spans over the timed repetitions
+    for (int rep = 0; rep < warmup + reps; rep++) {
+        PhaseTimes *timed = rep >= warmup ? &phases : NULL;
+        MPI_Barrier(MPI_COMM_WORLD); // Start every repetition together
+        double start = MPI_Wtime();
+
+        if (rows) {
+            if (share) broadcastShared(nodes, sharedArray2); // Between node leaders only, then the node reads the leader's copy
+            else MPI_Bcast(inputArray2.data, inputArray2.size(), MPI_INT, 0, MPI_COMM_WORLD); // Only inputArray2 is needed whole, inputArray1 is scattered by rows
+            bool received = rank != 0 && (!share || nodes.nodeRank == 0);
+            addPhase(timed, PHASE_DISTRIBUTE, start, received ? (double)inputArray2.size() * sizeof(int) : 0);
+            rowsMatrixMultiplication(MPI_COMM_WORLD, N, inputArray1, inputArray2, outputArray, program.multiply, timed); // Perform matrix multiplication
+        } else if (pipeline) {
+            pipelinedMultiply(MPI_COMM_WORLD, N, inputArray1, inputArray2, outputArray, panel, timed, share ? &nodes : NULL, share ? &sharedArray2 : NULL); // Scatter A, broadcast B panel by panel and send C back while the next panel is multiplied
+        } else if (strcmp(algorithm, "cannon") == 0) {
+            cannonMatrixMultiplication(grid, N, inputArray1, inputArray2, outputArray, program.multiply, timed); // Scatter blocks, skew, multiply and shift q times, gather C
+        } else {
+            summaMatrixMultiplication(grid, N, inputArray1, inputArray2, outputArray, program.multiply, timed); // Scatter blocks, multiply panel by panel, gather C
+        }
+
+        double elapsed = (MPI_Wtime() - start) * 1000, slowest = 0;
+        MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD); // A repetition lasts as long as its slowest rank
+        if (rep >= warmup) samples.push_back(slowest);
+    }
+
+    //if(rank==0)printArrays(outputArray);
+
+    int verified = -1;
+    if (rank == 0 && rounds > 0) {
+        double start = MPI_Wtime();
+        verified = freivaldsVerify(inputArray1, inputArray2, outputArray, rounds, seed); // O(N^2) check instead of a sequential rerun
+        addPhase(&phases, PHASE_VERIFY, start);
+    }
+    PhaseStats phaseStats = reducePhases(MPI_COMM_WORLD, phases, reps, 0); // Min, max and mean over the ranks
+
+    if (rank == 0){
+        double baselineMs = 0;
+        if (baseline) {
+            Matrix reference = createMatrix(N, N);
+            std::vector<double> sequential = timeRepetitions(warmup, reps, [&]() { blockedMatrixMultiply(inputArray1, inputArray2, reference, 0, N, defaultBlockSizes()); });
+            baselineMs = percentile(sequential, 0.5);
+            freeMatrix(reference);
+        }
+        char variant[64];
+        snprintf(variant, sizeof(variant), "%s-%s", program.variant, algorithm);
+        BenchResult result = summarise(variant, N, np * program.threads, microKernelName, warmup, samples, baselineMs);
+        if (program.pinning) result.pinning = program.pinning;
+        result.verified = verified;
+        printBenchHeader(stdout, format);
+        printBenchResult(stdout, format, result); // Print the timing summary
+        writePhaseReport(phasesPath, format, variant, N, np, reps, phaseStats); // One line per run for the scaling plots
+    }
+
+    freeMatrix(inputArray1);
+    if (share) freeSharedMatrix(sharedArray2);
+    else freeMatrix(inputArray2);
+    freeMatrix(outputArray);
+    freeProcessGrid(grid);
+    freeNodeComms(nodes);
+}       //MPI must already be initialised, the caller finalizes it
+
+#endif
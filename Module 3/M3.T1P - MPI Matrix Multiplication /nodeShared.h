@@ -0,0 +1,84 @@
+// nodeShared.h
+//
+// One copy per node of a matrix every rank needs whole (B in the row strip and pipelined multiplies).
+// Ranks that can share memory find each other with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED); the
+// lowest rank on each node is its leader and allocates the matrix in an MPI_Win_allocate_shared
+// window, the other ranks on the node map the leader's memory with MPI_Win_shared_query instead of
+// allocating their own. A broadcast then only runs between the leaders, one per node, and each leader
+// tells its node the data is ready with a barrier on the node communicator, so both the memory and
+// the broadcast volume drop by the number of ranks per node.
+//
+// The window stays in a passive MPI_Win_lock_all epoch for its whole life; MPI_Win_sync on either
+// side of the node barrier orders the leader's stores before the other ranks' loads, as the MPI
+// shared memory model requires.
+
+#ifndef NODE_SHARED_H
+#define NODE_SHARED_H
+
+#include <mpi.h>
+#include "../../Module 2/matrix.h"
+
+struct NodeComms {
+    MPI_Comm node; // Ranks on this node, ranked as in the parent communicator
+    MPI_Comm leaders; // Rank 0 of every node, MPI_COMM_NULL on the other ranks
+    int nodeRank;
+    int nodeSize;
+    int nodes; // Number of nodes, known on every rank
+};
+
+struct SharedMatrix {
+    Matrix m; // Points into the leader's window on every rank of the node
+    MPI_Win win;
+};
+
+inline NodeComms createNodeComms(MPI_Comm comm){
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    NodeComms c;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &c.node);
+    MPI_Comm_rank(c.node, &c.nodeRank);
+    MPI_Comm_size(c.node, &c.nodeSize);
+    MPI_Comm_split(comm, c.nodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &c.leaders); // The parent's rank 0 is leader 0
+    int leader = c.nodeRank == 0;
+    MPI_Allreduce(&leader, &c.nodes, 1, MPI_INT, MPI_SUM, comm);
+    return c;
+}
+
+inline void freeNodeComms(NodeComms &c){
+    if (c.leaders != MPI_COMM_NULL) MPI_Comm_free(&c.leaders);
+    MPI_Comm_free(&c.node);
+}
+
+inline SharedMatrix createSharedMatrix(const NodeComms &c, int rows, int cols){
+    SharedMatrix s;
+    s.m.rows = rows;
+    s.m.cols = cols;
+    s.m.stride = matrixStride<int>(cols);
+    MPI_Aint bytes = c.nodeRank == 0 ? (MPI_Aint)s.m.size() * sizeof(int) : 0; // Only the leader's part of the window has memory
+    MPI_Win_allocate_shared(bytes, sizeof(int), MPI_INFO_NULL, c.node, &s.m.data, &s.win);
+
+    MPI_Aint size;
+    int unit;
+    MPI_Win_shared_query(s.win, 0, &size, &unit, &s.m.data); // Everyone addresses the leader's copy
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, s.win);
+    return s;
+}       //rows x cols on the node leader, padded rows like createMatrix
+
+inline void freeSharedMatrix(SharedMatrix &s){
+    MPI_Win_unlock_all(s.win);
+    MPI_Win_free(&s.win);
+    s.m.data = NULL;
+}
+
+inline void nodeReady(const NodeComms &c, const SharedMatrix &s){
+    MPI_Win_sync(s.win);
+    MPI_Barrier(c.node);
+    MPI_Win_sync(s.win);
+}       //the leader's writes are visible to the whole node afterwards
+
+inline void broadcastShared(const NodeComms &c, SharedMatrix &s){
+    if (c.leaders != MPI_COMM_NULL) MPI_Bcast(s.m.data, s.m.size(), MPI_INT, 0, c.leaders); // One copy per node crosses the network
+    nodeReady(c, s);
+}       //the parent's rank 0 holds the data, every node ends up with it in its shared copy
+
+#endif
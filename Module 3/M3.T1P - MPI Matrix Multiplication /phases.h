@@ -0,0 +1,134 @@
+// phases.h
+//
+// Per-phase timing for the distributed multiplies. Every rank adds MPI_Wtime spans to four phases:
+//
+//     distribute   inputs moving to the ranks: scatters, broadcasts, Cannon's shifts, waits on panels
+//     compute      the local multiplies
+//     collect      results moving back to the root
+//     verify       the root's Freivalds check
+//
+// together with the bytes it received (distribute) or sent (collect) in that phase. At the end the
+// spans are reduced over the ranks to min, max and mean, the imbalance ratio max / mean (1 when every
+// rank took as long) and the effective bandwidth, all bytes moved / the slowest rank's span, so a slow
+// rank or a slow link shows up instead of disappearing into one end to end time. Verify only runs on
+// the root, so it is reported as the root's own span, with no imbalance.
+//
+// The report is one line per run, CSV or JSON like benchmark.h, with these fields:
+//
+//     variant, n, ranks, reps, then for each phase <phase>_min_ms, <phase>_max_ms, <phase>_mean_ms,
+//     <phase>_imbalance (empty / null for verify), <phase>_gbps (empty / null when the phase moved no data)
+//
+// It is appended to the file named by --phases=path, with a CSV header when the file is new, so runs
+// at different np collect into one table for strong and weak scaling plots; without --phases the line
+// goes to stderr.
+
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+
+enum Phase { PHASE_DISTRIBUTE, PHASE_COMPUTE, PHASE_COLLECT, PHASE_VERIFY, PHASE_COUNT };
+
+struct PhaseTimes {
+    double seconds[PHASE_COUNT];
+    double bytes[PHASE_COUNT];
+};
+
+struct PhaseStats {
+    double min[PHASE_COUNT]; // Milliseconds per repetition
+    double max[PHASE_COUNT];
+    double mean[PHASE_COUNT];
+    double imbalance[PHASE_COUNT]; // max / mean, 0 when no rank spent time in the phase, negative for root only phases
+    double gbps[PHASE_COUNT]; // All ranks' bytes / slowest span, negative when nothing moved
+};
+
+inline const char *phaseName(int phase){
+    static const char *names[PHASE_COUNT] = { "distribute", "compute", "collect", "verify" };
+    return names[phase];
+}
+
+inline bool rootOnlyPhase(int phase){
+    return phase == PHASE_VERIFY;
+}       //phases the other ranks never enter, so a spread over the ranks means nothing
+
+inline PhaseTimes createPhaseTimes(){
+    PhaseTimes t;
+    memset(&t, 0, sizeof(t));
+    return t;
+}
+
+inline void addPhase(PhaseTimes *times, Phase phase, double start, double bytes = 0){
+    if (!times) return;
+    times->seconds[phase] += MPI_Wtime() - start;
+    times->bytes[phase] += bytes;
+}       //adds the span from start to now, callers pass NULL when they are not being timed
+
+inline PhaseStats reducePhases(MPI_Comm comm, const PhaseTimes &times, int reps, int root){
+    int np;
+    MPI_Comm_size(comm, &np);
+    double ms[PHASE_COUNT], low[PHASE_COUNT], high[PHASE_COUNT], sum[PHASE_COUNT], bytes[PHASE_COUNT];
+    for (int p = 0; p < PHASE_COUNT; p++) ms[p] = times.seconds[p] * 1000 / (p == PHASE_VERIFY || reps < 1 ? 1 : reps); // Verify runs once, the rest every repetition
+    MPI_Reduce(ms, low, PHASE_COUNT, MPI_DOUBLE, MPI_MIN, root, comm);
+    MPI_Reduce(ms, high, PHASE_COUNT, MPI_DOUBLE, MPI_MAX, root, comm);
+    MPI_Reduce(ms, sum, PHASE_COUNT, MPI_DOUBLE, MPI_SUM, root, comm);
+    MPI_Reduce(times.bytes, bytes, PHASE_COUNT, MPI_DOUBLE, MPI_SUM, root, comm);
+
+    PhaseStats s;
+    memset(&s, 0, sizeof(s));
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        s.min[p] = low[p];
+        s.max[p] = high[p];
+        s.mean[p] = sum[p] / np;
+        s.imbalance[p] = s.mean[p] > 0 ? s.max[p] / s.mean[p] : 0;
+        if (rootOnlyPhase(p)) {
+            s.min[p] = s.max[p] = s.mean[p] = ms[p]; // Called on the root, which is the only rank with a span
+            s.imbalance[p] = -1;
+        }
+        double perRep = bytes[p] / (p == PHASE_VERIFY || reps < 1 ? 1 : reps);
+        s.gbps[p] = perRep > 0 && high[p] > 0 ? perRep / (high[p] * 1e6) : -1;
+    }
+    return s;
+}       //only meaningful on the root
+
+inline void printPhaseReport(FILE *out, const char *format, bool header, const char *variant, int n, int ranks, int reps, const PhaseStats &s){
+    bool json = strcmp(format, "json") == 0;
+    if (header && !json) {
+        fprintf(out, "variant,n,ranks,reps");
+        for (int p = 0; p < PHASE_COUNT; p++) fprintf(out, ",%s_min_ms,%s_max_ms,%s_mean_ms,%s_imbalance,%s_gbps", phaseName(p), phaseName(p), phaseName(p), phaseName(p), phaseName(p));
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, json ? "{\"variant\":\"%s\",\"n\":%d,\"ranks\":%d,\"reps\":%d" : "%s,%d,%d,%d", variant, n, ranks, reps);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        char gbps[32], imbalance[32];
+        if (s.gbps[p] >= 0) snprintf(gbps, sizeof(gbps), "%.3f", s.gbps[p]);
+        else strcpy(gbps, json ? "null" : "");
+        if (s.imbalance[p] >= 0) snprintf(imbalance, sizeof(imbalance), "%.3f", s.imbalance[p]);
+        else strcpy(imbalance, json ? "null" : "");
+        const char *name = phaseName(p);
+        if (json) fprintf(out, ",\"%s_min_ms\":%.3f,\"%s_max_ms\":%.3f,\"%s_mean_ms\":%.3f,\"%s_imbalance\":%s,\"%s_gbps\":%s", name, s.min[p], name, s.max[p], name, s.mean[p], name, imbalance, name, gbps);
+        else fprintf(out, ",%.3f,%.3f,%.3f,%s,%s", s.min[p], s.max[p], s.mean[p], imbalance, gbps);
+    }
+    fprintf(out, json ? "}\n" : "\n");
+    fflush(out);
+}
+
+inline void writePhaseReport(const char *path, const char *format, const char *variant, int n, int ranks, int reps, const PhaseStats &s){
+    if (!path || !*path) {
+        printPhaseReport(stderr, format, false, variant, n, ranks, reps, s);
+        return;
+    }
+    FILE *out = fopen(path, "a");
+    if (!out) {
+        fprintf(stderr, "cannot append the phase report to %s\n", path);
+        printPhaseReport(stderr, format, false, variant, n, ranks, reps, s);
+        return;
+    }
+    fseek(out, 0, SEEK_END);
+    printPhaseReport(out, format, ftell(out) == 0, variant, n, ranks, reps, s); // Header only at the top of a new file
+    fclose(out);
+}       //appends one line to --phases=path, or prints it to stderr
+
+#endif
@@ -0,0 +1,210 @@
+// pipeline.h
+//
+// Row strip multiply with communication overlapped with compute, C = A * B.
+// A is scattered by rows (MPI_Iscatterv) and B is broadcast in column panels with MPI_Ibcast, at most
+// PIPELINE_DEPTH panels in flight: while a rank multiplies its strip against panel k, panels k + 1 ..
+// are already on the wire. Every finished strip x panel block of C is sent to the root straight away
+// with MPI_Isend, and the root has posted matching MPI_Irecvs up front that land each block in place
+// in the output, so the collect phase overlaps the remaining panels too. The root's own strip is
+// computed directly into the output.
+//
+// MPI only moves a non-blocking transfer forward inside MPI calls unless the library runs a progress
+// thread, so the strip is multiplied in chunks of PIPELINE_CHUNK_ROWS rows with an MPI_Testall on the
+// outstanding requests between chunks. There are no barriers: each panel is waited on by the ranks
+// that need it, when they need it.
+//
+// Each received panel of B is packed once, all of its KC deep slices one after another in a
+// threadPackBuffer (gemm.h packPanelB), and every chunk of the strip is multiplied against the packed
+// panel, instead of packing the panel again for each chunk. Built with -fopenmp, the team shares out
+// the NR wide columns of the packing and of each chunk multiply; the master alone polls MPI between
+// the parallel loops, so MPI_THREAD_FUNNELED is enough.
+//
+// Given the node communicators and a SharedMatrix for B (nodeShared.h), only the node leaders take
+// part in the panel broadcasts, into the node's one copy of B. A leader that has a panel posts an
+// MPI_Ibarrier on the node communicator, and the rest of the node waits on its own side of that
+// barrier before reading the panel, with MPI_Win_sync on both sides as in nodeReady.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <mpi.h>
+#include <vector>
+#include "processGrid.h"
+#include "summa.h"
+#include "phases.h"
+#include "nodeShared.h"
+#include "../../Module 2/gemm.h"
+
+#define PIPELINE_PANEL 512 // Default columns of B per broadcast
+#define PIPELINE_DEPTH 2 // Panels in flight ahead of the one being multiplied
+#define PIPELINE_CHUNK_ROWS 256 // Rows of the strip multiplied between progress polls
+
+inline void progressRequests(std::vector<MPI_Request> &requests){
+    if (requests.empty()) return;
+    int flag;
+    MPI_Testall((int)requests.size(), requests.data(), &flag, MPI_STATUSES_IGNORE); // Completed requests become MPI_REQUEST_NULL
+}
+
+inline size_t packedSliceSize(const BlockSizes &bs, int width){
+    const int NR = KernelTraits<int, int>::NR;
+    return (size_t)packedDepth<KernelTraits<int, int>::KPACK>(bs.kc) * ((width + NR - 1) / NR * NR);
+}       //ints between the packed KC deep slices of one panel
+
+inline void packPanel(const Matrix &panelB, const BlockSizes &bs, int *packed){
+    const int NR = KernelTraits<int, int>::NR;
+    size_t slice = packedSliceSize(bs, panelB.cols);
+    for (int pc = 0; pc < panelB.rows; pc += bs.kc) {
+        int kc = panelB.rows - pc < bs.kc ? panelB.rows - pc : bs.kc;
+        int depth = packedDepth<KernelTraits<int, int>::KPACK>(kc);
+        int *dst = packed + pc / bs.kc * slice;
+        #pragma omp parallel for schedule(static)
+        for (int jr = 0; jr < panelB.cols; jr += NR) {
+            int width = panelB.cols - jr < NR ? panelB.cols - jr : NR;
+            packPanelB<int, int>(panelB, pc, kc, jr, width, dst + (size_t)jr * depth);
+        }
+    }
+}       //the whole n x width panel, packed NR columns per thread
+
+inline void multiplyPackedChunk(const Matrix &strip, const int *packed, Matrix &panelC, int r0, int r1, const BlockSizes &bs){
+    const int NR = KernelTraits<int, int>::NR;
+    int K = strip.cols, width = panelC.cols;
+    size_t slice = packedSliceSize(bs, width);
+    #pragma omp parallel
+    for (int pc = 0; pc < K; pc += bs.kc) {
+        int kc = K - pc < bs.kc ? K - pc : bs.kc;
+        int depth = packedDepth<KernelTraits<int, int>::KPACK>(kc);
+        const int *src = packed + pc / bs.kc * slice;
+        for (int ic = r0; ic < r1; ic += bs.mc) {
+            int mc = r1 - ic < bs.mc ? r1 - ic : bs.mc;
+            #pragma omp for schedule(static) nowait
+            for (int jr = 0; jr < width; jr += NR) {
+                int n = width - jr < NR ? width - jr : NR;
+                multiplyBlock<int, int>(strip, src + (size_t)jr * depth, panelC, ic, mc, pc, kc, jr, n, pc > 0);
+            }       //static over the same columns every time, so each thread keeps its own columns of C and needs no barrier
+        }
+    }
+}       //rows r0..r1 of the strip against the packed panel, GotoBLAS order with the panel already packed
+
+inline void pipelinedMultiply(MPI_Comm comm, int n, const Matrix &fullA, Matrix &B, Matrix &outputArray, int panel, PhaseTimes *times = NULL, const NodeComms *nodes = NULL, const SharedMatrix *shared = NULL){
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+    if (panel < 1) panel = PIPELINE_PANEL;
+    int panels = (n + panel - 1) / panel;
+    bool share = nodes != NULL && shared != NULL;
+    bool receives = !share || nodes->nodeRank == 0; // Ranks that take part in the panel broadcasts
+
+    BlockSizes bs = checkBlockSizes(defaultBlockSizes()), panelSizes = bs;
+    panelSizes.kc = (n + bs.kc - 1) / bs.kc * bs.kc; // Room for every slice of one panel
+    panelSizes.nc = (panel + KernelTraits<int, int>::NR - 1) / KernelTraits<int, int>::NR * KernelTraits<int, int>::NR;
+    int *packed = threadPackBuffer<PackedOf<int, int> >(panelSizes); // Kept between panels and calls, grown only for a bigger n or panel
+
+    int start, end;
+    partitionRows(n, np, rank, start, end);
+    Matrix strip = createMatrix(end - start, n); // This rank's rows of A
+    Matrix result = rank == 0 ? rowView(outputArray, start, end) : createMatrix(end - start, n); // Root writes its rows in place
+
+    std::vector<int> counts, displs;
+    if (rank == 0) {
+        counts.resize(np);
+        displs.resize(np);
+        for (int r = 0; r < np; r++) {
+            int s, e;
+            partitionRows(n, np, r, s, e);
+            counts[r] = (e - s) * strip.stride;
+            displs[r] = s * strip.stride;
+        }
+    }
+    MPI_Request scatter;
+    MPI_Iscatterv(fullA.data, counts.data(), displs.data(), MPI_INT, strip.data, strip.size(), MPI_INT, 0, comm, &scatter);
+
+    std::vector<MPI_Request> broadcasts(panels, MPI_REQUEST_NULL);
+    std::vector<MPI_Request> ready(panels, MPI_REQUEST_NULL); // Node barriers, a panel is in the shared copy of B
+    MPI_Comm panelComm = share ? nodes->leaders : comm;
+    std::vector<MPI_Datatype> panelTypes(panels);
+    for (int p = 0; p < panels; p++) {
+        int c0 = p * panel, width = c0 + panel < n ? panel : n - c0;
+        panelTypes[p] = blockType(subMatrix(B, 0, c0, n, width));
+    }
+    int posted = 0;
+    auto postPanels = [&](int upTo) { // Collectives are posted in the same order on every rank
+        for (; receives && posted < panels && posted < upTo; posted++) MPI_Ibcast(B[0] + posted * panel, 1, panelTypes[posted], 0, panelComm, &broadcasts[posted]);
+    };
+    postPanels(PIPELINE_DEPTH);
+
+    std::vector<MPI_Request> collect; // Isends on the workers, Irecvs on the root
+    std::vector<MPI_Datatype> blockTypes;
+    if (rank == 0) {
+        for (int r = 1; r < np; r++) {
+            int s, e;
+            partitionRows(n, np, r, s, e);
+            if (e == s) continue;
+            for (int p = 0; p < panels; p++) {
+                int c0 = p * panel, width = c0 + panel < n ? panel : n - c0;
+                Matrix block = subMatrix(outputArray, s, c0, e - s, width);
+                blockTypes.push_back(blockType(block));
+                collect.push_back(MPI_REQUEST_NULL);
+                MPI_Irecv(block.data, 1, blockTypes.back(), r, p, comm, &collect.back());
+            }
+        }
+    }       //every block of C has its own place in the output, so all receives can be posted at once
+
+    double phase = MPI_Wtime();
+    MPI_Wait(&scatter, MPI_STATUS_IGNORE);
+    addPhase(times, PHASE_DISTRIBUTE, phase, rank != 0 ? (double)strip.rows * n * sizeof(int) : 0);
+    for (int p = 0; p < panels; p++) {
+        int c0 = p * panel, width = c0 + panel < n ? panel : n - c0;
+        phase = MPI_Wtime();
+        if (receives) {
+            MPI_Wait(&broadcasts[p], MPI_STATUS_IGNORE);
+            postPanels(p + 1 + PIPELINE_DEPTH); // Keep the next panels moving while this one is multiplied
+            if (share) {
+                MPI_Win_sync(shared->win);
+                MPI_Ibarrier(nodes->node, &ready[p]); // Tell the node panel p is there, without waiting for it to read it
+            }
+        } else {
+            MPI_Ibarrier(nodes->node, &ready[p]);
+            MPI_Wait(&ready[p], MPI_STATUS_IGNORE); // Until the leader has panel p
+            MPI_Win_sync(shared->win);
+        }
+        addPhase(times, PHASE_DISTRIBUTE, phase, rank != 0 && receives ? (double)n * width * sizeof(int) : 0); // Only the time spent waiting, the rest is hidden
+
+        Matrix panelB = subMatrix(B, 0, c0, n, width);
+        Matrix panelC = subMatrix(result, 0, c0, result.rows, width);
+        if (strip.rows > 0) {
+            phase = MPI_Wtime();
+            packPanel(panelB, bs, packed); // Once per panel, shared by every chunk below
+            addPhase(times, PHASE_COMPUTE, phase);
+        }
+        for (int r0 = 0; r0 < strip.rows; r0 += PIPELINE_CHUNK_ROWS) {
+            int r1 = r0 + PIPELINE_CHUNK_ROWS < strip.rows ? r0 + PIPELINE_CHUNK_ROWS : strip.rows;
+            phase = MPI_Wtime();
+            multiplyPackedChunk(strip, packed, panelC, r0, r1, bs);
+            addPhase(times, PHASE_COMPUTE, phase);
+            phase = MPI_Wtime();
+            progressRequests(broadcasts);
+            progressRequests(ready);
+            progressRequests(collect);
+            addPhase(times, PHASE_DISTRIBUTE, phase);
+        }
+
+        if (rank != 0 && strip.rows > 0) {
+            phase = MPI_Wtime();
+            blockTypes.push_back(blockType(panelC));
+            collect.push_back(MPI_REQUEST_NULL);
+            MPI_Isend(panelC.data, 1, blockTypes.back(), 0, p, comm, &collect.back()); // Send this block of C while the next panel is multiplied
+            addPhase(times, PHASE_COLLECT, phase, (double)panelC.rows * width * sizeof(int));
+        }
+    }
+
+    phase = MPI_Wtime();
+    MPI_Waitall((int)collect.size(), collect.data(), MPI_STATUSES_IGNORE);
+    MPI_Waitall(panels, ready.data(), MPI_STATUSES_IGNORE);
+    addPhase(times, PHASE_COLLECT, phase);
+    for (size_t i = 0; i < blockTypes.size(); i++) MPI_Type_free(&blockTypes[i]);
+    for (int p = 0; p < panels; p++) MPI_Type_free(&panelTypes[p]);
+    freeMatrix(strip);
+    if (rank != 0) freeMatrix(result);
+}       //B must be n x n on every rank (or the node's shared copy), filled on the root; fullA and outputArray are only used on the root
+
+#endif
@@ -0,0 +1,147 @@
+// processGrid.h
+//
+// 2D process grid for the distributed matrix multiplies (SUMMA, Cannon).
+// The np ranks are laid out as rows x cols, rank r at grid position (r / cols, r % cols), with one
+// communicator per grid row and one per grid column for the panel broadcasts and block shifts.
+// An N x N matrix is cut into matching blocks: grid row i owns rows partitionRows(N, rows, i) and
+// grid column j owns columns partitionRows(N, cols, j), so uneven N / grid sizes are handled.
+//
+// scatterBlocks / gatherBlocks move the blocks between the root's full matrix and every rank's
+// local block with one MPI_Scatterv / MPI_Gatherv; a vector datatype lets the local side send and
+// receive straight into its padded rows. When N is smaller than a grid dimension some blocks have no
+// rows or no columns; those are sent as 0 MPI_INTs (blockCount / blockType), never as an empty vector
+// type, which MPI libraries do not all match against the root's zero count.
+
+#ifndef PROCESS_GRID_H
+#define PROCESS_GRID_H
+
+#include <mpi.h>
+#include <math.h>
+#include <vector>
+#include "../../Module 2/matrix.h"
+
+struct ProcessGrid {
+    MPI_Comm comm;
+    int np;
+    int rank;
+    int rows; // Grid rows
+    int cols; // Grid columns
+    int row; // This rank's grid row
+    int col; // This rank's grid column
+    MPI_Comm rowComm; // Ranks in the same grid row, ranked by column
+    MPI_Comm colComm; // Ranks in the same grid column, ranked by row
+};
+
+inline void chooseGridShape(int np, int &rows, int &cols){
+    rows = (int)sqrt((double)np);
+    while (rows > 1 && np % rows != 0) rows--; // Largest divisor of np that is at most sqrt(np)
+    cols = np / rows;
+}
+
+inline ProcessGrid createProcessGrid(MPI_Comm comm){
+    ProcessGrid g;
+    g.comm = comm;
+    MPI_Comm_size(comm, &g.np);
+    MPI_Comm_rank(comm, &g.rank);
+    chooseGridShape(g.np, g.rows, g.cols);
+    g.row = g.rank / g.cols;
+    g.col = g.rank % g.cols;
+    MPI_Comm_split(comm, g.row, g.col, &g.rowComm); // Rank in rowComm is the grid column
+    MPI_Comm_split(comm, g.col, g.row, &g.colComm); // Rank in colComm is the grid row
+    return g;
+}
+
+inline void freeProcessGrid(ProcessGrid &g){
+    MPI_Comm_free(&g.rowComm);
+    MPI_Comm_free(&g.colComm);
+}
+
+inline void gridBlock(const ProcessGrid &g, int n, int gridRow, int gridCol, int &rowStart, int &rowEnd, int &colStart, int &colEnd){
+    partitionRows(n, g.rows, gridRow, rowStart, rowEnd);
+    partitionRows(n, g.cols, gridCol, colStart, colEnd);
+}
+
+inline Matrix createLocalBlock(const ProcessGrid &g, int n){
+    int rowStart, rowEnd, colStart, colEnd;
+    gridBlock(g, n, g.row, g.col, rowStart, rowEnd, colStart, colEnd);
+    return createMatrix(rowEnd - rowStart, colEnd - colStart);
+}
+
+inline int gridOwner(int n, int parts, int index){
+    int base = n / parts, extra = n % parts;
+    int big = extra * (base + 1); // Rows held by the first extra parts, which are one longer
+    return index < big ? index / (base + 1) : extra + (index - big) / base;
+}       //which part of partitionRows(n, parts, ...) holds index
+
+inline bool emptyBlock(const Matrix &m){
+    return m.rows == 0 || m.cols == 0;
+}
+
+inline int blockCount(const Matrix &m){
+    return emptyBlock(m) ? 0 : 1;
+}       //count to send blockType(m) with
+
+inline MPI_Datatype blockType(const Matrix &m){
+    if (emptyBlock(m)) return MPI_INT; // Sent with a count of 0
+    MPI_Datatype type;
+    MPI_Type_vector(m.rows, m.cols, m.stride, MPI_INT, &type);
+    MPI_Type_commit(&type);
+    return type;
+}       //the rows x cols ints of m in place, skipping the padding at the end of each row
+
+inline void freeBlockType(MPI_Datatype &type){
+    if (type != MPI_INT) MPI_Type_free(&type);
+}
+
+inline void blockCounts(const ProcessGrid &g, int n, std::vector<int> &counts, std::vector<int> &displs){
+    counts.resize(g.np);
+    displs.resize(g.np);
+    int offset = 0;
+    for (int r = 0; r < g.np; r++) {
+        int rowStart, rowEnd, colStart, colEnd;
+        gridBlock(g, n, r / g.cols, r % g.cols, rowStart, rowEnd, colStart, colEnd);
+        counts[r] = (rowEnd - rowStart) * (colEnd - colStart);
+        displs[r] = offset;
+        offset += counts[r];
+    }
+}       //packed size and offset of every rank's block, blocks are packed one after another in rank order
+
+inline void scatterBlocks(const ProcessGrid &g, int n, const Matrix &full, Matrix &local, int root){
+    std::vector<int> counts, displs;
+    std::vector<int> packed;
+    if (g.rank == root) {
+        blockCounts(g, n, counts, displs);
+        packed.resize((size_t)n * n);
+        for (int r = 0; r < g.np; r++) {
+            int rowStart, rowEnd, colStart, colEnd;
+            gridBlock(g, n, r / g.cols, r % g.cols, rowStart, rowEnd, colStart, colEnd);
+            int *dst = packed.data() + displs[r];
+            for (int i = rowStart; i < rowEnd; i++, dst += colEnd - colStart) memcpy(dst, full[i] + colStart, (colEnd - colStart) * sizeof(int));
+        }
+    }
+    MPI_Datatype type = blockType(local);
+    MPI_Scatterv(packed.data(), counts.data(), displs.data(), MPI_INT, local.data, blockCount(local), type, root, g.comm);
+    freeBlockType(type);
+}       //hands every rank its block of the root's full matrix
+
+inline void gatherBlocks(const ProcessGrid &g, int n, const Matrix &local, Matrix &full, int root){
+    std::vector<int> counts, displs;
+    std::vector<int> packed;
+    if (g.rank == root) {
+        blockCounts(g, n, counts, displs);
+        packed.resize((size_t)n * n);
+    }
+    MPI_Datatype type = blockType(local);
+    MPI_Gatherv(local.data, blockCount(local), type, packed.data(), counts.data(), displs.data(), MPI_INT, root, g.comm);
+    freeBlockType(type);
+    if (g.rank == root) {
+        for (int r = 0; r < g.np; r++) {
+            int rowStart, rowEnd, colStart, colEnd;
+            gridBlock(g, n, r / g.cols, r % g.cols, rowStart, rowEnd, colStart, colEnd);
+            const int *src = packed.data() + displs[r];
+            for (int i = rowStart; i < rowEnd; i++, src += colEnd - colStart) memcpy(full[i] + colStart, src, (colEnd - colStart) * sizeof(int));
+        }
+    }
+}       //collects every rank's block into the root's full matrix
+
+#endif
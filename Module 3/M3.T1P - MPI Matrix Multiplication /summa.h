@@ -0,0 +1,64 @@
+// summa.h
+//
+// SUMMA (Scalable Universal Matrix Multiplication Algorithm) on a 2D process grid, C = A * B.
+// A, B and C are all cut into the same grid blocks (processGrid.h) and every rank keeps only its
+// own three blocks plus one A and one B panel. The k dimension is walked in panels of at most
+// `panel` columns: the ranks that own a panel of A broadcast it along their grid row, the ranks that
+// own the matching panel of B broadcast it down their grid column, and every rank adds
+// A panel * B panel to its block of C.
+//
+// Per rank that is N^2 / cols + N^2 / rows ints received over the whole multiply instead of 2 N^2
+// for broadcasting both inputs, so on a square grid the traffic per rank falls as sqrt(P).
+// Panels never straddle a block boundary, so grids with uneven blocks and rows != cols work too, as
+// do N smaller than the grid, where some ranks own empty blocks and only take part in the broadcasts.
+
+#ifndef SUMMA_H
+#define SUMMA_H
+
+#include "processGrid.h"
+#include "phases.h"
+#include "../../Module 2/gemm.h"
+
+typedef void (*LocalMultiply)(const Matrix &A, const Matrix &B, Matrix &C, bool accumulate); // C = A * B, or C += A * B
+
+inline void summaMultiply(const ProcessGrid &g, int n, const Matrix &localA, const Matrix &localB, Matrix &localC, int panel, LocalMultiply multiply, PhaseTimes *times = NULL){
+    Matrix panelA = createMatrix(localA.rows, panel); // Receive buffers for the panels other ranks own
+    Matrix panelB = createMatrix(panel, localB.cols);
+    int colStart, colEnd, rowStart, rowEnd;
+    partitionRows(n, g.cols, g.col, colStart, colEnd); // k range of my block of A
+    partitionRows(n, g.rows, g.row, rowStart, rowEnd); // k range of my block of B
+
+    for (int k = 0; k < n; ) {
+        int ownerCol = gridOwner(n, g.cols, k); // Grid column holding columns k.. of A
+        int ownerRow = gridOwner(n, g.rows, k); // Grid row holding rows k.. of B
+        int aStart, aEnd, bStart, bEnd;
+        partitionRows(n, g.cols, ownerCol, aStart, aEnd);
+        partitionRows(n, g.rows, ownerRow, bStart, bEnd);
+        int end = k + panel;
+        if (end > aEnd) end = aEnd;
+        if (end > bEnd) end = bEnd; // Stop at whichever block boundary comes first
+        int width = end - k;
+
+        Matrix a = g.col == ownerCol ? subMatrix(localA, 0, k - colStart, localA.rows, width) : subMatrix(panelA, 0, 0, localA.rows, width);
+        Matrix b = g.row == ownerRow ? subMatrix(localB, k - rowStart, 0, width, localB.cols) : subMatrix(panelB, 0, 0, width, localB.cols);
+
+        double start = MPI_Wtime();
+        MPI_Datatype typeA = blockType(a), typeB = blockType(b);
+        MPI_Bcast(a.data, blockCount(a), typeA, ownerCol, g.rowComm); // Owner sends straight out of its block, the others receive into the panel
+        MPI_Bcast(b.data, blockCount(b), typeB, ownerRow, g.colComm); // A grid row or column with no rows or columns of C broadcasts 0 ints
+        freeBlockType(typeA);
+        freeBlockType(typeB);
+        double received = (g.col != ownerCol ? (double)a.rows * a.cols : 0) + (g.row != ownerRow ? (double)b.rows * b.cols : 0);
+        addPhase(times, PHASE_DISTRIBUTE, start, received * sizeof(int));
+
+        start = MPI_Wtime();
+        multiply(a, b, localC, k > 0); // First panel overwrites C, the rest add to it
+        addPhase(times, PHASE_COMPUTE, start);
+        k = end;
+    }
+
+    freeMatrix(panelA);
+    freeMatrix(panelB);
+}       //localC = rows of my grid row x columns of my grid column of A * B
+
+#endif
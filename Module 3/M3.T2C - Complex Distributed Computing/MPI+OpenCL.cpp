@@ -3,6 +3,7 @@
 #include <time.h>
 #include <mpi.h>
 #include <CL/cl.hpp>
+#include "../../Module 2/clBinaryCache.h"
 
 #define MAX 1000000
 #define WORKGROUP_SIZE 256
@@ -36,15 +37,30 @@ int main(int argc, char *argv[])
     cl::Buffer output_buffer(context, CL_MEM_WRITE_ONLY, sizeof(int));
 
     // Create OpenCL program and kernel
-    cl::Program program(context, "#pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable\n __kernel void sum(__global int *input, __global int *output, const int local_size) { \n\
+    const char *source = "#pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable\n __kernel void sum(__global int *input, __global int *output, const int local_size) { \n\
         int sum = 0; \n\
         __global int *data = input + get_global_id(0) * local_size; \n\
         for (int i = 0; i < local_size; i++) { \n\
             sum += data[i]; \n\
         } \n\
         atom_add(output, sum); \n\
-    }");
-    program.build(devices);
+    }";
+
+    // Build once per node: the first rank compiles and fills the binary cache, the others load it
+    MPI_Comm node;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    int node_rank;
+    MPI_Comm_rank(node, &node_rank);
+    if (node_rank != 0) MPI_Barrier(node);
+    cl_int err;
+    cl::Program program(buildCachedProgram(context(), devices[0](), source, "", &err)); // Takes over the cl_program
+    if (node_rank == 0) MPI_Barrier(node);
+    MPI_Comm_free(&node);
+    if (err != CL_SUCCESS)
+    {
+        std::cerr << "Building the sum kernel failed: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]) << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
     cl::Kernel kernel(program, "sum");
 
     // Set kernel arguments